@@ -0,0 +1,161 @@
+#ifndef AFFINE3F_H
+#define AFFINE3F_H
+
+#include "Matrix4f.h"
+#include "Vector3f.h"
+
+// 3x4 affine transformation (linear part plus translation), stored in row major order.
+// Everything is inline. Components are read as raw floats, since the Vector3f accessors are
+// not, so the float* overloads compile down to plain multiply-adds and the Vector3f ones only
+// add the call to the Vector3f constructor. The inverse-transpose of the linear part is
+// cached for normals.
+class Affine3f
+{
+public:
+
+	// Identity
+	Affine3f()
+	{
+		for( int i = 0; i < 9; ++i )
+		{
+			m_linear[ i ] = ( i % 4 == 0 ) ? 1.f : 0.f;
+			m_normal[ i ] = m_linear[ i ];
+		}
+		m_translation[ 0 ] = m_translation[ 1 ] = m_translation[ 2 ] = 0.f;
+	}
+
+	// Upper 3x4 block of m, the last row is assumed to be (0, 0, 0, 1)
+	explicit Affine3f( const Matrix4f& m )
+	{
+		for( int i = 0; i < 3; ++i )
+		{
+			for( int j = 0; j < 3; ++j )
+			{
+				m_linear[ 3 * i + j ] = m( i, j );
+			}
+			m_translation[ i ] = m( i, 3 );
+		}
+		updateNormalMatrix();
+	}
+
+	Matrix4f toMatrix4f() const
+	{
+		return Matrix4f( m_linear[ 0 ], m_linear[ 1 ], m_linear[ 2 ], m_translation[ 0 ],
+			m_linear[ 3 ], m_linear[ 4 ], m_linear[ 5 ], m_translation[ 1 ],
+			m_linear[ 6 ], m_linear[ 7 ], m_linear[ 8 ], m_translation[ 2 ],
+			0.f, 0.f, 0.f, 1.f );
+	}
+
+	// A * p + t, written to out ( which may be p )
+	void transformPoint( const float* p, float* out ) const
+	{
+		multiply( m_linear, p, out );
+		out[ 0 ] += m_translation[ 0 ];
+		out[ 1 ] += m_translation[ 1 ];
+		out[ 2 ] += m_translation[ 2 ];
+	}
+
+	// A * v
+	void transformVector( const float* v, float* out ) const
+	{
+		multiply( m_linear, v, out );
+	}
+
+	// inverse( A )^T * n, not normalized
+	void transformNormal( const float* n, float* out ) const
+	{
+		multiply( m_normal, n, out );
+	}
+
+	Vector3f transformPoint( const Vector3f& p ) const
+	{
+		float out[ 3 ];
+		transformPoint( components( p ), out );
+		return Vector3f( out[ 0 ], out[ 1 ], out[ 2 ] );
+	}
+
+	Vector3f transformVector( const Vector3f& v ) const
+	{
+		float out[ 3 ];
+		transformVector( components( v ), out );
+		return Vector3f( out[ 0 ], out[ 1 ], out[ 2 ] );
+	}
+
+	Vector3f transformNormal( const Vector3f& n ) const
+	{
+		float out[ 3 ];
+		transformNormal( components( n ), out );
+		return Vector3f( out[ 0 ], out[ 1 ], out[ 2 ] );
+	}
+
+	float determinant() const
+	{
+		return m_linear[ 0 ] * ( m_linear[ 4 ] * m_linear[ 8 ] - m_linear[ 5 ] * m_linear[ 7 ] )
+			- m_linear[ 1 ] * ( m_linear[ 3 ] * m_linear[ 8 ] - m_linear[ 5 ] * m_linear[ 6 ] )
+			+ m_linear[ 2 ] * ( m_linear[ 3 ] * m_linear[ 7 ] - m_linear[ 4 ] * m_linear[ 6 ] );
+	}
+
+	// The cached normal matrix already is inverse( A )^T, so no second 3x3 inversion is needed
+	Affine3f inverse() const
+	{
+		Affine3f result;
+		for( int i = 0; i < 3; ++i )
+		{
+			for( int j = 0; j < 3; ++j )
+			{
+				result.m_linear[ 3 * i + j ] = m_normal[ 3 * j + i ];
+				result.m_normal[ 3 * i + j ] = m_linear[ 3 * j + i ];
+			}
+		}
+		for( int i = 0; i < 3; ++i )
+		{
+			result.m_translation[ i ] = -( result.m_linear[ 3 * i ] * m_translation[ 0 ]
+				+ result.m_linear[ 3 * i + 1 ] * m_translation[ 1 ]
+				+ result.m_linear[ 3 * i + 2 ] * m_translation[ 2 ] );
+		}
+		return result;
+	}
+
+private:
+
+	// Vector3f is standard layout with its three floats as the only member, so they can be
+	// read without the out-of-line operator []
+	static const float* components( const Vector3f& v )
+	{
+		return reinterpret_cast< const float* >( &v );
+	}
+
+	// out = m * v for a row major 3x3 matrix m
+	static void multiply( const float* m, const float* v, float* out )
+	{
+		float x = v[ 0 ], y = v[ 1 ], z = v[ 2 ];
+		out[ 0 ] = m[ 0 ] * x + m[ 1 ] * y + m[ 2 ] * z;
+		out[ 1 ] = m[ 3 ] * x + m[ 4 ] * y + m[ 5 ] * z;
+		out[ 2 ] = m[ 6 ] * x + m[ 7 ] * y + m[ 8 ] * z;
+	}
+
+	// inverse-transpose via the cofactor matrix: inverse( A )^T = cofactor( A ) / det( A )
+	void updateNormalMatrix()
+	{
+		const float* a = m_linear;
+		float cofactor[ 9 ] =
+		{
+			a[ 4 ] * a[ 8 ] - a[ 5 ] * a[ 7 ], a[ 5 ] * a[ 6 ] - a[ 3 ] * a[ 8 ], a[ 3 ] * a[ 7 ] - a[ 4 ] * a[ 6 ],
+			a[ 2 ] * a[ 7 ] - a[ 1 ] * a[ 8 ], a[ 0 ] * a[ 8 ] - a[ 2 ] * a[ 6 ], a[ 1 ] * a[ 6 ] - a[ 0 ] * a[ 7 ],
+			a[ 1 ] * a[ 5 ] - a[ 2 ] * a[ 4 ], a[ 2 ] * a[ 3 ] - a[ 0 ] * a[ 5 ], a[ 0 ] * a[ 4 ] - a[ 1 ] * a[ 3 ]
+		};
+		float det = a[ 0 ] * cofactor[ 0 ] + a[ 1 ] * cofactor[ 1 ] + a[ 2 ] * cofactor[ 2 ];
+		float invDet = ( det != 0.f ) ? 1.f / det : 0.f;
+		for( int i = 0; i < 9; ++i )
+		{
+			m_normal[ i ] = cofactor[ i ] * invDet;
+		}
+	}
+
+	float m_linear[ 9 ];
+	float m_translation[ 3 ];
+	float m_normal[ 9 ];
+
+};
+
+#endif // AFFINE3F_H
@@ -1,6 +1,7 @@
 #ifndef VECMATH_H
 #define VECMATH_H
 
+#include "Affine3f.h"
 #include "Matrix2f.h"
 #include "Matrix3f.h"
 #include "Matrix4f.h"
@@ -11,84 +11,115 @@
 
 class AABB {
 public:
-    AABB() = default;
+    // Empty box
+    AABB() {
+        for (int i = 0; i < 3; i++) {
+            bounds[0][i] = MAXFLOAT;
+            bounds[1][i] = -MAXFLOAT;
+        }
+    }
 
-    AABB(const Interval &x, const Interval &y, const Interval &z) : x(x), y(y), z(z) {}
+    AABB(const Interval &x, const Interval &y, const Interval &z) {
+        setAxis(0, x);
+        setAxis(1, y);
+        setAxis(2, z);
+    }
 
     AABB(const Vector3f &p1, const Vector3f &p2) {
-        x = p1.x() < p2.x() ? Interval(p1.x(), p2.x()) : Interval(p2.x(), p1.x());
-        y = p1.y() < p2.y() ? Interval(p1.y(), p2.y()) : Interval(p2.y(), p1.y());
-        z = p1.z() < p2.z() ? Interval(p1.z(), p2.z()) : Interval(p2.z(), p1.z());
+        for (int i = 0; i < 3; i++) {
+            bounds[0][i] = std::min(p1[i], p2[i]);
+            bounds[1][i] = std::max(p1[i], p2[i]);
+        }
     }
 
     AABB(const AABB &aabb1, const AABB &aabb2) {
-        x = Interval(aabb1.getX(), aabb2.getX());
-        y = Interval(aabb1.getY(), aabb2.getY());
-        z = Interval(aabb1.getZ(), aabb2.getZ());
+        for (int i = 0; i < 3; i++) {
+            bounds[0][i] = std::min(aabb1.bounds[0][i], aabb2.bounds[0][i]);
+            bounds[1][i] = std::max(aabb1.bounds[1][i], aabb2.bounds[1][i]);
+        }
     }
 
     void expand(const AABB &aabb) {
-        x = Interval(x, aabb.getX());
-        y = Interval(y, aabb.getY());
-        z = Interval(z, aabb.getZ());
+        for (int i = 0; i < 3; i++) {
+            bounds[0][i] = std::min(bounds[0][i], aabb.bounds[0][i]);
+            bounds[1][i] = std::max(bounds[1][i], aabb.bounds[1][i]);
+        }
     }
 
     void expand(const Vector3f& p) {
-        x = Interval(std::min(x.getMin(), p.x()), std::max(x.getMax(), p.x()));
-        y = Interval(std::min(y.getMin(), p.y()), std::max(y.getMax(), p.y()));
-        z = Interval(std::min(z.getMin(), p.z()), std::max(z.getMax(), p.z()));
+        for (int i = 0; i < 3; i++) {
+            bounds[0][i] = std::min(bounds[0][i], p[i]);
+            bounds[1][i] = std::max(bounds[1][i], p[i]);
+        }
     }
 
     Interval getX() const {
-        return x;
+        return getAxis(0);
     }
 
     Interval getY() const {
-        return y;
+        return getAxis(1);
     }
 
     Interval getZ() const {
-        return z;
+        return getAxis(2);
     }
 
     Interval getAxis(int axis) const {
-        if (axis == 0) return x;
-        if (axis == 1) return y;
-        return z;
+        return Interval(bounds[0][axis], bounds[1][axis]);
     }
 
     int getLongestAxis() const {
-        float dx = x.getLength();
-        float dy = y.getLength();
-        float dz = z.getLength();
+        float dx = bounds[1][0] - bounds[0][0];
+        float dy = bounds[1][1] - bounds[0][1];
+        float dz = bounds[1][2] - bounds[0][2];
         if (dx > dy && dx > dz) return 0;
         if (dy > dz) return 1;
         return 2;
     }
 
+    float getSurfaceArea() const {
+        float dx = bounds[1][0] - bounds[0][0];
+        float dy = bounds[1][1] - bounds[0][1];
+        float dz = bounds[1][2] - bounds[0][2];
+        if (dx < 0 || dy < 0 || dz < 0) return 0;
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
     Vector3f getMin() const {
-        return Vector3f(x.getMin(), y.getMin(), z.getMin());
+        return Vector3f(bounds[0][0], bounds[0][1], bounds[0][2]);
     }
 
     Vector3f getMax() const {
-        return Vector3f(x.getMax(), y.getMax(), z.getMax());
+        return Vector3f(bounds[1][0], bounds[1][1], bounds[1][2]);
     }
 
+    // Slab test with the reciprocal direction of the ray. The sign of each direction
+    // component picks the near and far plane, so no swaps are needed, and the interval
+    // is only checked once at the end. NaNs from 0 * inf (a ray in a slab plane) fail the
+    // comparisons and leave the interval unchanged.
     bool intersect(const Ray &r, float tmin, float tmax) const {
-        float t1 = tmin, t2 = tmax;
+        return intersect(&r.getOrigin()[0], r, tmin, tmax);
+    }
+
+    // Same test with the origin of r passed as plain floats, for loops over many boxes
+    bool intersect(const float *o, const Ray &r, float tmin, float tmax) const {
+        const float *invD = r.getInvDirection();
         for (int i = 0; i < 3; i++) {
-            float invD = 1.0f / r.getDirection()[i];
-            float tNear = (getMin()[i] - r.getOrigin()[i]) * invD;
-            float tFar = (getMax()[i] - r.getOrigin()[i]) * invD;
-            if (tNear > tFar) std::swap(tNear, tFar);
-            t1 = tNear > t1 ? tNear : t1;
-            t2 = tFar < t2 ? tFar : t2;
-            if (t1 > t2) return false;
+            float tNear = (bounds[r.getSign(i)][i] - o[i]) * invD[i];
+            float tFar = (bounds[1 - r.getSign(i)][i] - o[i]) * invD[i];
+            tmin = tNear > tmin ? tNear : tmin;
+            tmax = tFar < tmax ? tFar : tmax;
         }
-        return true;
+        return tmin <= tmax;
     }
 private:
-    Interval x, y, z;
+    float bounds[2][3];     // min, max
+
+    void setAxis(int axis, const Interval &interval) {
+        bounds[0][axis] = interval.getMin();
+        bounds[1][axis] = interval.getMax();
+    }
 };
 
 #endif //RAYTRACING_AABB_HPP
@@ -0,0 +1,30 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_ACCELERATOR_HPP
+#define RAYTRACING_ACCELERATOR_HPP
+
+#include "object3d.hpp"
+
+// Structure built once over all objects of a scene that rays are traced against instead
+// of the objects themselves. Scene::setAcceleratorType() picks the implementation.
+class Accelerator : public Object3D {
+public:
+    // Bytes of the structure itself, not counting the objects it refers to
+    virtual size_t getMemoryUsage() const = 0;
+
+protected:
+    // Objects that span the whole Interval::Full() range on some axis, such as planes, are
+    // kept out of cells and nodes and tested against every ray instead
+    static bool isBounded(const AABB &box) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (box.getAxis(axis).getLength() >= Interval::Full().getLength()) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif //RAYTRACING_ACCELERATOR_HPP
@@ -0,0 +1,51 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_ALIGNED_ALLOCATOR_HPP
+#define RAYTRACING_ALIGNED_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Allocator for std::vector whose arrays start at a multiple of Alignment bytes, e.g. a
+// cache line or a page, which std::allocator does not guarantee before C++17
+template <typename T, size_t Alignment>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(size_t count) {
+        void *pointer = nullptr;
+        if (posix_memalign(&pointer, Alignment, count * sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(pointer);
+    }
+
+    void deallocate(T *pointer, size_t) {
+        free(pointer);
+    }
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &) {
+    return true;
+}
+
+template <typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &) {
+    return false;
+}
+
+#endif //RAYTRACING_ALIGNED_ALLOCATOR_HPP
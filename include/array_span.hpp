@@ -0,0 +1,51 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_ARRAY_SPAN_HPP
+#define RAYTRACING_ARRAY_SPAN_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Non-owning, read-only view of a contiguous array, such as a std::vector or a
+// section of a memory-mapped file. The viewed memory must outlive the span.
+template <typename T>
+class ArraySpan {
+public:
+    ArraySpan() : pointer(nullptr), count(0) {}
+
+    ArraySpan(const T *pointer, size_t count) : pointer(pointer), count(count) {}
+
+    ArraySpan(const std::vector<T> &vector) : pointer(vector.data()), count(vector.size()) {}
+
+    const T &operator[](size_t i) const {
+        return pointer[i];
+    }
+
+    const T *data() const {
+        return pointer;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    const T *begin() const {
+        return pointer;
+    }
+
+    const T *end() const {
+        return pointer + count;
+    }
+
+private:
+    const T *pointer;
+    size_t count;
+};
+
+#endif //RAYTRACING_ARRAY_SPAN_HPP
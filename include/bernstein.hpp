@@ -7,7 +7,7 @@
 
 #include <cmath>
 
-int binomialCoefficient(int n, int k) {
+inline int binomialCoefficient(int n, int k) {
     if (k > n) {
         return 0;
     }
@@ -26,11 +26,11 @@ int binomialCoefficient(int n, int k) {
     return result;
 }
 
-float bernstein(int n, int i, float u) {
+inline float bernstein(int n, int i, float u) {
     return binomialCoefficient(n, i) * pow(u, i) * pow(1 - u, n - i);
 }
 
-float bernsteinDerivative(int n, int i, float u) {
+inline float bernsteinDerivative(int n, int i, float u) {
     if (i == 0) {
         return -n * bernstein(n - 1, i, u);
     } else if (i == n) {
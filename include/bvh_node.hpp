@@ -5,14 +5,129 @@
 #ifndef RAYTRACING_BVH_NODE_HPP
 #define RAYTRACING_BVH_NODE_HPP
 
-#include "object3d.hpp"
+#include "accelerator.hpp"
 #include "group.hpp"
 
-class BVHNode : public Object3D {
+class BVHNode : public Accelerator {
 public:
     BVHNode() = delete;
 
     BVHNode(std::vector<Object3D*> objects) {
+        build(objects);
+    }
+
+    ~BVHNode() override {
+        deleteChildren();
+    }
+
+    bool intersect(const Ray &r, Hit &h, float tmin) const override {
+        if (!aabb.intersect(r, tmin, h.getT())) {
+            return false;
+        }
+        bool hit_left = left->intersect(r, h, tmin);
+        bool hit_right = right != nullptr && right->intersect(r, h, tmin);
+        return hit_left || hit_right;
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        if (!aabb.intersect(r, tmin, tmax)) {
+            return false;
+        }
+        return left->occluded(r, tmin, tmax) || (right != nullptr && right->occluded(r, tmin, tmax));
+    }
+
+    void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const override {
+        if (!aabb.intersect(r, -MAXFLOAT, MAXFLOAT)) {
+            return;
+        }
+        left->getCrossings(r, crossings);
+        if (right != nullptr) right->getCrossings(r, crossings);
+    }
+
+    AABB getAABB() const override {
+        return aabb;
+    }
+
+    // Recompute the bounds bottom-up after primitives moved, keeping the topology.
+    // Also updates the SAH cost of every subtree.
+    void refit() {
+        BVHNode *leftNode = dynamic_cast<BVHNode*>(left);
+        BVHNode *rightNode = dynamic_cast<BVHNode*>(right);
+        if (leftNode != nullptr) leftNode->refit();
+        if (rightNode != nullptr) rightNode->refit();
+
+        aabb = left->getAABB();
+        if (right != nullptr) aabb.expand(right->getAABB());
+        cost = computeCost();
+    }
+
+    // Rebuild the topmost subtrees whose SAH cost (relative to their own surface area)
+    // grew past threshold times the cost they had when they were built.
+    // Must be called after refit(). Returns the number of rebuilt subtrees.
+    int rebuildDegraded(float threshold) {
+        if (getRelativeCost() > threshold * buildCost) {
+            std::vector<Object3D*> objects;
+            collectPrimitives(objects);
+            deleteChildren();
+            build(objects);
+            return 1;
+        }
+
+        int rebuilt = 0;
+        BVHNode *leftNode = dynamic_cast<BVHNode*>(left);
+        BVHNode *rightNode = dynamic_cast<BVHNode*>(right);
+        if (leftNode != nullptr) rebuilt += leftNode->rebuildDegraded(threshold);
+        if (rightNode != nullptr) rebuilt += rightNode->rebuildDegraded(threshold);
+        if (rebuilt > 0) {
+            aabb = left->getAABB();
+            if (right != nullptr) aabb.expand(right->getAABB());
+            cost = computeCost();
+        }
+        return rebuilt;
+    }
+
+    Object3D *getLeft() const {
+        return left;
+    }
+
+    // nullptr if this node holds a single object
+    Object3D *getRight() const {
+        return right;
+    }
+
+    size_t getMemoryUsage() const override {
+        return getNodeCount() * sizeof(BVHNode);
+    }
+
+    int getNodeCount() const {
+        auto leftNode = dynamic_cast<const BVHNode*>(left);
+        auto rightNode = dynamic_cast<const BVHNode*>(right);
+        return 1 + (leftNode != nullptr ? leftNode->getNodeCount() : 0)
+                 + (rightNode != nullptr ? rightNode->getNodeCount() : 0);
+    }
+
+    // SAH cost of this subtree divided by the surface area of its bounds
+    float getRelativeCost() const {
+        float area = aabb.getSurfaceArea();
+        return area > 0 ? cost / area : 0;
+    }
+
+    void collectPrimitives(std::vector<Object3D*> &objects) const {
+        collectPrimitives(left, objects);
+        if (right != nullptr) collectPrimitives(right, objects);
+    }
+
+    static constexpr float TraversalCost = 1.0f;
+    static constexpr float IntersectionCost = 1.0f;
+
+private:
+    Object3D *left;
+    Object3D *right;
+    AABB aabb;
+    float cost;         // un-normalized SAH cost of this subtree
+    float buildCost;    // relative SAH cost right after (re)building
+
+    void build(std::vector<Object3D*> &objects) {
         aabb = AABB();
         for (auto object : objects) {
             aabb.expand(object->getAABB());
@@ -35,25 +150,38 @@ public:
             left = new BVHNode(left_objects);
             right = new BVHNode(right_objects);
         }
+
+        cost = computeCost();
+        buildCost = getRelativeCost();
     }
 
-    bool intersect(const Ray &r, Hit &h, float tmin) const override {
-        if (!aabb.intersect(r, tmin, h.getT())) {
-            return false;
-        }
-        bool hit_left = left->intersect(r, h, tmin);
-        bool hit_right = right != nullptr && right->intersect(r, h, tmin);
-        return hit_left || hit_right;
+    float computeCost() const {
+        float area = aabb.getSurfaceArea();
+        float result = TraversalCost * area;
+        result += childCost(left, area);
+        if (right != nullptr) result += childCost(right, area);
+        return result;
     }
 
-    AABB getAABB() const override {
-        return aabb;
+    static float childCost(const Object3D *child, float parentArea) {
+        auto node = dynamic_cast<const BVHNode*>(child);
+        return node != nullptr ? node->cost : IntersectionCost * parentArea;
     }
 
-private:
-    Object3D *left;
-    Object3D *right;
-    AABB aabb;
+    static void collectPrimitives(Object3D *child, std::vector<Object3D*> &objects) {
+        auto node = dynamic_cast<BVHNode*>(child);
+        if (node != nullptr) {
+            node->collectPrimitives(objects);
+        } else {
+            objects.push_back(child);
+        }
+    }
+
+    void deleteChildren() {
+        delete dynamic_cast<BVHNode*>(left);
+        delete dynamic_cast<BVHNode*>(right);
+        left = right = nullptr;
+    }
 };
 
 #endif //RAYTRACING_BVH_NODE_HPP
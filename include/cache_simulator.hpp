@@ -0,0 +1,80 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_CACHE_SIMULATOR_HPP
+#define RAYTRACING_CACHE_SIMULATOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Set associative cache with least recently used replacement that only tracks which lines
+// it holds. Fed the addresses a traversal touches, it tells how many of them a cache of that
+// size would have served, independently of what else runs on the machine. With the page
+// size as line size, it stands for a TLB of bytes / lineSize entries.
+class CacheSimulator {
+public:
+    explicit CacheSimulator(size_t bytes = 32 * 1024, int ways = 8, size_t lineSize = 64)
+        : lineSize(lineSize), ways(std::max(1, ways)),
+          setCount(std::max<size_t>(1, bytes / lineSize / std::max(1, ways))) {
+        reset();
+    }
+
+    // Whether the line holding address was cached. It is cached afterwards either way.
+    bool access(const void *address) {
+        uintptr_t line = (uintptr_t) address / lineSize;
+        size_t first = (line % setCount) * ways;
+        accesses++;
+        clock++;
+
+        size_t victim = first;
+        for (size_t i = first; i < first + ways; i++) {
+            if (tags[i] == line) {
+                lastUse[i] = clock;
+                hits++;
+                return true;
+            }
+            if (lastUse[i] < lastUse[victim]) {
+                victim = i;
+            }
+        }
+        tags[victim] = line;
+        lastUse[victim] = clock;
+        return false;
+    }
+
+    // Empties the cache and the counters
+    void reset() {
+        tags.assign(setCount * ways, ~(uintptr_t) 0);
+        lastUse.assign(setCount * ways, 0);
+        clock = 0;
+        accesses = 0;
+        hits = 0;
+    }
+
+    long long getAccesses() const {
+        return accesses;
+    }
+
+    long long getHits() const {
+        return hits;
+    }
+
+    float getHitRate() const {
+        return accesses > 0 ? (float) hits / accesses : 0;
+    }
+
+private:
+    size_t lineSize;
+    size_t ways;
+    size_t setCount;
+    std::vector<uintptr_t> tags;
+    std::vector<uint64_t> lastUse;
+    uint64_t clock = 0;
+    long long accesses = 0;
+    long long hits = 0;
+};
+
+#endif //RAYTRACING_CACHE_SIMULATOR_HPP
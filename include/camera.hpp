@@ -28,6 +28,7 @@ public:
 
     int getWidth() const { return width; }
     int getHeight() const { return height; }
+    Vector3f getCenter() const { return center; }
 
 protected:
     // Extrinsic parameters
@@ -69,6 +70,11 @@ public:
 
         return Ray(orig, dir);
     }
+
+    // Width of the world-space footprint of one pixel at the given distance from the camera
+    float getPixelSize(float distance) const {
+        return distance * 2 * scaleRatio / width;
+    }
 private:
     float scaleRatio;
     float aperture = 0.3;
@@ -0,0 +1,195 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_COMPRESSED_BVH_HPP
+#define RAYTRACING_COMPRESSED_BVH_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include "accelerator.hpp"
+#include "bvh_node.hpp"
+
+// Flattened copy of a BVHNode tree in which the bounds of both children are stored
+// as 8 bit offsets inside the parent's box. Quantization always rounds outwards, so
+// the decoded boxes contain the exact ones and the result of a traversal is unchanged.
+class CompressedBVH : public Accelerator {
+public:
+    CompressedBVH() = delete;
+
+    explicit CompressedBVH(const BVHNode *root) {
+        AABB box = root->getAABB();
+        for (int axis = 0; axis < 3; axis++) {
+            rootMin[axis] = box.getAxis(axis).getMin();
+            rootMax[axis] = box.getAxis(axis).getMax();
+        }
+        build(root, rootMin, rootMax);
+    }
+
+    bool intersect(const Ray &r, Hit &h, float tmin) const override {
+        return traverse(r, h, tmin, [&](const Object3D *primitive) {
+            return primitive->intersect(r, h, tmin);
+        }, false);
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        Hit h(tmax, nullptr, Vector3f::ZERO);
+        return traverse(r, h, tmin, [&](const Object3D *primitive) {
+            return primitive->occluded(r, tmin, tmax);
+        }, true);
+    }
+
+    AABB getAABB() const override {
+        return AABB(Vector3f(rootMin[0], rootMin[1], rootMin[2]), Vector3f(rootMax[0], rootMax[1], rootMax[2]));
+    }
+
+    size_t getMemoryUsage() const override {
+        return sizeof(CompressedBVH) + nodes.size() * sizeof(Node) + primitives.size() * sizeof(Object3D*);
+    }
+
+    int getPrimitiveCount() const {
+        return (int) primitives.size();
+    }
+
+private:
+    static const uint32_t LeafFlag = 0x80000000u;
+    static const uint32_t Empty = 0xffffffffu;
+
+    // Boxes are culled against h.getT(). leaf(primitive) tests a primitive, and with anyHit
+    // the traversal ends at the first leaf that reports a hit.
+    template <typename Leaf>
+    bool traverse(const Ray &r, const Hit &h, float tmin, Leaf leaf, bool anyHit) const {
+        if (nodes.empty() || !intersectBox(rootMin, rootMax, r, tmin, h.getT())) {
+            return false;
+        }
+
+        struct Entry {
+            uint32_t node;
+            float min[3], max[3];
+        };
+        Entry stack[64];
+        int top = 0;
+        stack[top].node = 0;
+        std::copy(rootMin, rootMin + 3, stack[top].min);
+        std::copy(rootMax, rootMax + 3, stack[top].max);
+        top++;
+
+        bool result = false;
+        while (top > 0) {
+            Entry entry = stack[--top];
+            const Node &node = nodes[entry.node];
+
+            // Push the right child first, so that the left child is visited first like in BVHNode
+            for (int i = 1; i >= 0; i--) {
+                uint32_t child = node.child[i];
+                if (child == Empty) continue;
+
+                Entry next;
+                decode(node, i, entry.min, entry.max, next.min, next.max);
+                if (!intersectBox(next.min, next.max, r, tmin, h.getT())) continue;
+
+                if (child & LeafFlag) {
+                    result |= leaf(primitives[child & ~LeafFlag]);
+                    if (result && anyHit) return true;
+                } else {
+                    next.node = child;
+                    stack[top++] = next;
+                }
+            }
+        }
+        return result;
+    }
+
+    struct Node {
+        uint8_t lo[2][3];
+        uint8_t hi[2][3];
+        uint32_t child[2];  // node index, primitive index | LeafFlag, or Empty
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Object3D*> primitives;
+    float rootMin[3], rootMax[3];
+
+    // Returns the index of the new node
+    uint32_t build(const BVHNode *bvhNode, const float *parentMin, const float *parentMax) {
+        uint32_t index = (uint32_t) nodes.size();
+        nodes.emplace_back();
+
+        const Object3D *children[2] = {bvhNode->getLeft(), bvhNode->getRight()};
+        for (int i = 0; i < 2; i++) {
+            if (children[i] == nullptr) {
+                nodes[index].child[i] = Empty;
+                std::fill(nodes[index].lo[i], nodes[index].lo[i] + 3, 0);
+                std::fill(nodes[index].hi[i], nodes[index].hi[i] + 3, 0);
+                continue;
+            }
+
+            AABB box = children[i]->getAABB();
+            for (int axis = 0; axis < 3; axis++) {
+                quantize(box.getAxis(axis), parentMin[axis], parentMax[axis],
+                         nodes[index].lo[i][axis], nodes[index].hi[i][axis]);
+            }
+
+            auto childNode = dynamic_cast<const BVHNode*>(children[i]);
+            if (childNode == nullptr) {
+                nodes[index].child[i] = (uint32_t) primitives.size() | LeafFlag;
+                primitives.push_back(const_cast<Object3D*>(children[i]));
+            } else {
+                // Children are quantized against the decoded box, which is what traversal sees
+                float childMin[3], childMax[3];
+                decode(nodes[index], i, parentMin, parentMax, childMin, childMax);
+                uint32_t childIndex = build(childNode, childMin, childMax);
+                nodes[index].child[i] = childIndex;
+            }
+        }
+        return index;
+    }
+
+    static float dequantize(uint8_t q, float min, float max) {
+        return q == 255 ? max : min + (max - min) * (q / 255.0f);
+    }
+
+    static void quantize(const Interval &interval, float min, float max, uint8_t &lo, uint8_t &hi) {
+        float extent = max - min;
+        if (extent <= 0) {
+            lo = 0;
+            hi = 255;
+            return;
+        }
+
+        int l = (int) std::floor((interval.getMin() - min) / extent * 255.0f);
+        int u = (int) std::ceil((interval.getMax() - min) / extent * 255.0f);
+        l = std::max(0, std::min(255, l));
+        u = std::max(0, std::min(255, u));
+
+        // Step outwards until float rounding can no longer make the decoded box too small
+        while (l > 0 && dequantize((uint8_t) l, min, max) > interval.getMin()) l--;
+        while (u < 255 && dequantize((uint8_t) u, min, max) < interval.getMax()) u++;
+        lo = (uint8_t) l;
+        hi = (uint8_t) u;
+    }
+
+    static void decode(const Node &node, int i, const float *parentMin, const float *parentMax,
+                       float *min, float *max) {
+        for (int axis = 0; axis < 3; axis++) {
+            min[axis] = dequantize(node.lo[i][axis], parentMin[axis], parentMax[axis]);
+            max[axis] = dequantize(node.hi[i][axis], parentMin[axis], parentMax[axis]);
+        }
+    }
+
+    // Same slab test as AABB::intersect
+    static bool intersectBox(const float *min, const float *max, const Ray &r, float tmin, float tmax) {
+        const float *o = &r.getOrigin()[0];
+        const float *invD = r.getInvDirection();
+        for (int i = 0; i < 3; i++) {
+            float tNear = ((r.getSign(i) ? max : min)[i] - o[i]) * invD[i];
+            float tFar = ((r.getSign(i) ? min : max)[i] - o[i]) * invD[i];
+            tmin = tNear > tmin ? tNear : tmin;
+            tmax = tFar < tmax ? tFar : tmax;
+        }
+        return tmin <= tmax;
+    }
+};
+
+#endif //RAYTRACING_COMPRESSED_BVH_HPP
@@ -4,6 +4,8 @@
 #ifndef RAYTRACING_CONSTANT_MEDIUM_HPP
 #define RAYTRACING_CONSTANT_MEDIUM_HPP
 
+#include <algorithm>
+#include <vector>
 #include "object3d.hpp"
 
 class ConstantMedium : public Object3D {
@@ -16,27 +18,33 @@ public:
         delete phaseFunction;
     }
 
+    // The boundary reports all the parts of the ray inside it in one query, which also works
+    // for rays scattered inside the medium and for boundaries the ray enters more than once
     bool intersect(const Ray &r, Hit &h, float tmin) const override {
-        Hit h1, h2;
-        if (!boundary->intersect(r, h1, tmin))
+        // Reused, so that rays do not allocate, unless a medium in the boundary of this one
+        // is queried while the outer query still fills it
+        static thread_local std::vector<Interval> reused;
+        static thread_local bool busy = false;
+        std::vector<Interval> nested;
+        std::vector<Interval> &intervals = busy ? nested : reused;
+        bool outer = !busy;
+        busy = true;
+        intervals.clear();
+        boundary->getIntervals(r, std::max(tmin, 0.0f), h.getT(), intervals);
+        if (outer) busy = false;
+        if (intervals.empty())
             return false;
-        if (!boundary->intersect(r, h2, h1.getT() + 0.0001f))
-            return false;
-
-        auto h1T = h1.getT();
-        auto h2T = h2.getT();
-        if (h1T < tmin) h1T = tmin;
-        if (h2T > h.getT()) h2T = h.getT();
-        if (h1T >= h2T)
-            return false;
-
-        if (h1T < 0) h1T = 0;
 
-        float distanceInsideBoundary = (h2T - h1T) * r.getDirection().length();
+        // Distances are exponential, so one sample covers the intervals laid end to end
+        float length = r.getDirection().length();
         float hitDistance = negInvDensity * log(drand48());
-        if (hitDistance < distanceInsideBoundary) {
-            h.set(h1T + hitDistance / r.getDirection().length(), phaseFunction, Vector3f(1, 0, 0));
-            return true;
+        for (const Interval &interval : intervals) {
+            float distanceInsideBoundary = interval.getLength() * length;
+            if (hitDistance < distanceInsideBoundary) {
+                h.set(interval.getMin() + hitDistance / length, phaseFunction, Vector3f(1, 0, 0));
+                return true;
+            }
+            hitDistance -= distanceInsideBoundary;
         }
         return false;
     }
@@ -0,0 +1,362 @@
+//
+// Referencing Box2D's b2DynamicTree and
+// Kopta et al., "Fast, Effective BVH Updates for Animated Scenes"
+//
+
+#ifndef RAYTRACING_DYNAMIC_BVH_HPP
+#define RAYTRACING_DYNAMIC_BVH_HPP
+
+#include <vector>
+#include <unordered_map>
+#include "accelerator.hpp"
+
+// BVH supporting incremental insertion and removal of objects.
+// Leaves are inserted next to the sibling that minimizes the SAH cost increase,
+// and tree rotations on the way back up keep the tree quality close to a full build.
+class DynamicBVH : public Accelerator {
+public:
+    DynamicBVH() : root(Null), freeList(Null) {}
+
+    explicit DynamicBVH(const std::vector<Object3D*> &objects) : DynamicBVH() {
+        nodes.reserve(2 * objects.size());
+        for (auto object : objects) {
+            insert(object);
+        }
+    }
+
+    bool intersect(const Ray &r, Hit &h, float tmin) const override {
+        if (root == Null) return false;
+
+        // A depth-first traversal never holds more than height + 1 nodes on its stack
+        auto leaf = [&](const Object3D *object) {
+            return object->intersect(r, h, tmin);
+        };
+        int height = nodes[root].height;
+        if (height < MaxStackDepth) {
+            int stack[MaxStackDepth];
+            return traverse(stack, r, h, tmin, leaf, false);
+        }
+        std::vector<int> stack(height + 1);
+        return traverse(stack.data(), r, h, tmin, leaf, false);
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        if (root == Null) return false;
+
+        Hit h(tmax, nullptr, Vector3f::ZERO);
+        auto leaf = [&](const Object3D *object) {
+            return object->occluded(r, tmin, tmax);
+        };
+        int height = nodes[root].height;
+        if (height < MaxStackDepth) {
+            int stack[MaxStackDepth];
+            return traverse(stack, r, h, tmin, leaf, true);
+        }
+        std::vector<int> stack(height + 1);
+        return traverse(stack.data(), r, h, tmin, leaf, true);
+    }
+
+    void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const override {
+        if (root == Null) return;
+
+        Hit h(MAXFLOAT, nullptr, Vector3f::ZERO);
+        auto leaf = [&](const Object3D *object) {
+            object->getCrossings(r, crossings);
+            return false;
+        };
+        int height = nodes[root].height;
+        if (height < MaxStackDepth) {
+            int stack[MaxStackDepth];
+            traverse(stack, r, h, -MAXFLOAT, leaf, false);
+            return;
+        }
+        std::vector<int> stack(height + 1);
+        traverse(stack.data(), r, h, -MAXFLOAT, leaf, false);
+    }
+
+    AABB getAABB() const override {
+        return root == Null ? AABB() : nodes[root].aabb;
+    }
+
+    // Objects already in the tree are ignored, a second leaf would be hit twice and never removed
+    void insert(Object3D *object) {
+        if (contains(object)) return;
+
+        int leaf = allocateNode();
+        nodes[leaf].aabb = object->getAABB();
+        nodes[leaf].object = object;
+        leaves[object] = leaf;
+        insertLeaf(leaf);
+    }
+
+    bool contains(Object3D *object) const {
+        return leaves.count(object) > 0;
+    }
+
+    void remove(Object3D *object) {
+        auto it = leaves.find(object);
+        if (it == leaves.end()) return;
+
+        removeLeaf(it->second);
+        freeNode(it->second);
+        leaves.erase(it);
+    }
+
+    // Re-insert the object if its bounds changed since it was inserted
+    void update(Object3D *object) {
+        auto it = leaves.find(object);
+        if (it == leaves.end()) return;
+
+        int leaf = it->second;
+        AABB aabb = object->getAABB();
+        if (sameBounds(aabb, nodes[leaf].aabb)) return;
+
+        removeLeaf(leaf);
+        nodes[leaf].aabb = aabb;
+        insertLeaf(leaf);
+    }
+
+    void updateAll() {
+        for (auto &entry : leaves) {
+            update(entry.first);
+        }
+    }
+
+    int getObjectCount() const {
+        return (int) leaves.size();
+    }
+
+    // Counting the object to leaf map as one pointer, index and bucket link per entry
+    size_t getMemoryUsage() const override {
+        return sizeof(DynamicBVH) + nodes.capacity() * sizeof(Node)
+               + leaves.size() * (sizeof(Object3D*) + sizeof(int) + sizeof(void*))
+               + leaves.bucket_count() * sizeof(void*);
+    }
+
+private:
+    static const int Null = -1;
+    static const int MaxStackDepth = 64;
+
+    struct Node {
+        AABB aabb;
+        Object3D *object;   // nullptr for internal nodes
+        int parent, left, right;
+        int height;         // leaves have height 0; -1 marks a free node
+
+        bool isLeaf() const {
+            return left == Null;
+        }
+    };
+
+    std::vector<Node> nodes;
+    std::unordered_map<Object3D*, int> leaves;
+    int root;
+    int freeList;       // free nodes are chained through their parent index
+
+    // Boxes are culled against h.getT(). leaf(object) tests an object, and with anyHit the
+    // traversal ends at the first leaf that reports a hit.
+    template <typename Leaf>
+    bool traverse(int *stack, const Ray &r, const Hit &h, float tmin, Leaf leaf, bool anyHit) const {
+        bool result = false;
+        int top = 0;
+        stack[top++] = root;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            if (!node.aabb.intersect(r, tmin, h.getT())) continue;
+
+            if (node.isLeaf()) {
+                result |= leaf(node.object);
+                if (result && anyHit) return true;
+            } else {
+                stack[top++] = node.left;
+                stack[top++] = node.right;
+            }
+        }
+        return result;
+    }
+
+    int allocateNode() {
+        int id;
+        if (freeList != Null) {
+            id = freeList;
+            freeList = nodes[id].parent;
+        } else {
+            id = (int) nodes.size();
+            nodes.emplace_back();
+        }
+        Node &node = nodes[id];
+        node.aabb = AABB();
+        node.object = nullptr;
+        node.parent = node.left = node.right = Null;
+        node.height = 0;
+        return id;
+    }
+
+    void freeNode(int id) {
+        nodes[id].parent = freeList;
+        nodes[id].height = -1;
+        freeList = id;
+    }
+
+    static bool sameBounds(const AABB &a, const AABB &b) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (a.getAxis(axis).getMin() != b.getAxis(axis).getMin() ||
+                a.getAxis(axis).getMax() != b.getAxis(axis).getMax())
+                return false;
+        }
+        return true;
+    }
+
+    // Branch and bound search for the sibling minimizing the total SAH cost increase
+    int findBestSibling(const AABB &leafAABB) const {
+        float leafArea = leafAABB.getSurfaceArea();
+        int best = root;
+        float bestCost = AABB(leafAABB, nodes[root].aabb).getSurfaceArea();
+
+        // (node, surface area increase inherited from its ancestors)
+        std::vector<std::pair<int, float>> queue;
+        queue.emplace_back(root, 0.0f);
+        while (!queue.empty()) {
+            int index = queue.back().first;
+            float inherited = queue.back().second;
+            queue.pop_back();
+
+            const Node &node = nodes[index];
+            float directCost = AABB(leafAABB, node.aabb).getSurfaceArea();
+            float cost = directCost + inherited;
+            if (cost < bestCost) {
+                bestCost = cost;
+                best = index;
+            }
+
+            if (node.isLeaf()) continue;
+            float childInherited = inherited + directCost - node.aabb.getSurfaceArea();
+            if (leafArea + childInherited < bestCost) {
+                queue.emplace_back(node.left, childInherited);
+                queue.emplace_back(node.right, childInherited);
+            }
+        }
+        return best;
+    }
+
+    void insertLeaf(int leaf) {
+        if (root == Null) {
+            root = leaf;
+            nodes[root].parent = Null;
+            return;
+        }
+
+        int sibling = findBestSibling(nodes[leaf].aabb);
+
+        int oldParent = nodes[sibling].parent;
+        int newParent = allocateNode();
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].aabb = AABB(nodes[leaf].aabb, nodes[sibling].aabb);
+        nodes[newParent].height = nodes[sibling].height + 1;
+        nodes[newParent].left = sibling;
+        nodes[newParent].right = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+
+        if (oldParent == Null) {
+            root = newParent;
+        } else if (nodes[oldParent].left == sibling) {
+            nodes[oldParent].left = newParent;
+        } else {
+            nodes[oldParent].right = newParent;
+        }
+
+        refitAncestors(nodes[leaf].parent);
+    }
+
+    void removeLeaf(int leaf) {
+        if (leaf == root) {
+            root = Null;
+            return;
+        }
+
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+        if (grandParent == Null) {
+            root = sibling;
+            nodes[sibling].parent = Null;
+        } else {
+            if (nodes[grandParent].left == parent) {
+                nodes[grandParent].left = sibling;
+            } else {
+                nodes[grandParent].right = sibling;
+            }
+            nodes[sibling].parent = grandParent;
+            refitAncestors(grandParent);
+        }
+        freeNode(parent);
+    }
+
+    // Walk up to the root, rotating and refitting every ancestor
+    void refitAncestors(int index) {
+        while (index != Null) {
+            rotate(index);
+            refitNode(index);
+            index = nodes[index].parent;
+        }
+    }
+
+    void refitNode(int index) {
+        Node &node = nodes[index];
+        node.aabb = AABB(nodes[node.left].aabb, nodes[node.right].aabb);
+        node.height = 1 + std::max(nodes[node.left].height, nodes[node.right].height);
+    }
+
+    // Try swapping a child of this node with a grandchild on the other side and keep the
+    // swap that shrinks the surface area of the modified child the most.
+    void rotate(int index) {
+        int b = nodes[index].left, c = nodes[index].right;
+
+        int bestChild = Null, bestGrandChild = Null;
+        float bestGain = 0;
+        tryRotation(b, c, bestChild, bestGrandChild, bestGain);
+        tryRotation(c, b, bestChild, bestGrandChild, bestGain);
+
+        if (bestChild == Null) return;
+
+        // bestChild swaps places with bestGrandChild, whose parent is the other child
+        int other = nodes[bestGrandChild].parent;
+        if (nodes[index].left == bestChild) {
+            nodes[index].left = bestGrandChild;
+        } else {
+            nodes[index].right = bestGrandChild;
+        }
+        if (nodes[other].left == bestGrandChild) {
+            nodes[other].left = bestChild;
+        } else {
+            nodes[other].right = bestChild;
+        }
+        nodes[bestGrandChild].parent = index;
+        nodes[bestChild].parent = other;
+        refitNode(other);
+    }
+
+    // Evaluate swapping child with one of the children of other
+    void tryRotation(int child, int other, int &bestChild, int &bestGrandChild, float &bestGain) const {
+        const Node &o = nodes[other];
+        if (o.isLeaf()) return;
+
+        float area = o.aabb.getSurfaceArea();
+        float gainLeft = area - AABB(nodes[child].aabb, nodes[o.right].aabb).getSurfaceArea();
+        float gainRight = area - AABB(nodes[child].aabb, nodes[o.left].aabb).getSurfaceArea();
+        if (gainLeft > bestGain) {
+            bestGain = gainLeft;
+            bestChild = child;
+            bestGrandChild = o.left;
+        }
+        if (gainRight > bestGain) {
+            bestGain = gainRight;
+            bestChild = child;
+            bestGrandChild = o.right;
+        }
+    }
+};
+
+#endif //RAYTRACING_DYNAMIC_BVH_HPP
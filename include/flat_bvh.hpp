@@ -0,0 +1,549 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_FLAT_BVH_HPP
+#define RAYTRACING_FLAT_BVH_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include "accelerator.hpp"
+#include "aligned_allocator.hpp"
+#include "bvh_node.hpp"
+#include "cache_simulator.hpp"
+#include "sphere.hpp"
+#include "quad.hpp"
+#include "triangle.hpp"
+#include "surface.hpp"
+#include "primitive_packet.hpp"
+
+// Flattened copy of a BVHNode tree whose leaves hold up to PacketWidth primitives. The
+// spheres and quads of a leaf are packed into one SpherePacket and one QuadPacket, which
+// are tested against the ray all at once. Triangles and Bezier patches are copied into one
+// contiguous array per type. Leaves refer to packets and copies by a type tag and an index,
+// so the leaf loop calls each intersection routine directly (and inlined) instead of
+// through Object3D. Everything else, including subclasses of these types and spheres with
+// rotated texture coordinates, stays behind an Object3D pointer. Packet lanes keep only
+// the geometry and a material id: hits in packets record the FlatBVH, which computes the
+// surface like Sphere and Quad would, so the original objects may be deleted after the
+// build. Hits on copies record the copies.
+//
+// The two children of a node are stored next to each other, so that a pair of siblings
+// fills one cache line. Pairs are laid out depth first, or grouped into page sized
+// treelets: starting from the most probable pair not laid out yet, a treelet takes the
+// most probable pairs below it until its page is full. A pair is tested as often as its
+// parent is entered, which is in proportion to the surface area of the parent's box
+// (Gil and Yoon, "Cache-Oblivious Layouts of Bounding Volume Hierarchies", 2006, and
+// Aila and Karras, "Architecture Considerations for Tracing Incoherent Rays", 2010).
+// The top of the tree thus shares the first lines of the first page, and a ray crossing
+// the tree touches fewer pages.
+class FlatBVH : public Accelerator {
+public:
+    enum Layout { DepthFirstLayout, TreeletLayout };
+
+    FlatBVH() = delete;
+
+    explicit FlatBVH(const BVHNode *root, Layout layout = TreeletLayout) {
+        build(root, layout);
+    }
+
+    bool intersect(const Ray &r, Hit &h, float tmin) const override {
+        const float *o = &r.getOrigin()[0];
+        const float *d = &r.getDirection()[0];
+        return traverse(r, h, tmin, [&](PrimitiveRef ref) {
+            return intersectRef(ref, r, o, d, h, tmin);
+        }, [](const Node &) {}, false);
+    }
+
+    // Same as intersect(), also passing every node it visits to nodeCache, to measure how
+    // well the order rays are traced in reuses the nodes already cached
+    bool intersect(const Ray &r, Hit &h, float tmin, CacheSimulator &nodeCache) const {
+        const float *o = &r.getOrigin()[0];
+        const float *d = &r.getDirection()[0];
+        return traverse(r, h, tmin, [&](PrimitiveRef ref) {
+            return intersectRef(ref, r, o, d, h, tmin);
+        }, [&](const Node &node) {
+            nodeCache.access(&node);
+        }, false);
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        const float *o = &r.getOrigin()[0];
+        const float *d = &r.getDirection()[0];
+        Hit h(tmax, nullptr, Vector3f::ZERO);
+        return traverse(r, h, tmin, [&](PrimitiveRef ref) {
+            return occludedRef(ref, r, o, d, tmin, tmax);
+        }, [](const Node &) {}, true);
+    }
+
+    // Closest hits of count independent rays, with results[i] telling whether rays[i] hit
+    // anything. Up to width rays are in flight and take turns advancing by one step: the
+    // node a ray visits next, or the primitives of a leaf it is about to test, are
+    // prefetched before moving on to the next ray, so that the cache miss overlaps with the
+    // work on the others. Finds the same hits as intersect(), and pays off for incoherent
+    // rays in scenes much larger than the caches.
+    void intersect(const Ray *rays, Hit *hits, bool *results, int count, float tmin,
+                   int width = DefaultInterleaveWidth) const {
+        traverseInterleaved(rays, hits, results, count, tmin, width, [&](PrimitiveRef ref, const RayState &state) {
+            return intersectRef(ref, rays[state.ray], state.o, state.d, hits[state.ray], tmin);
+        }, false);
+    }
+
+    // Whether each of count rays hits anything at tmin < t < tmax, interleaved like intersect()
+    void occluded(const Ray *rays, bool *results, int count, float tmin, float tmax,
+                  int width = DefaultInterleaveWidth) const {
+        std::vector<float> tmaxs(count, tmax);
+        occluded(rays, results, count, tmin, tmaxs.data(), width);
+    }
+
+    // Same with a tmax per ray
+    void occluded(const Ray *rays, bool *results, int count, float tmin, const float *tmaxs,
+                  int width = DefaultInterleaveWidth) const {
+        std::vector<Hit> hits;
+        hits.reserve(count);
+        for (int i = 0; i < count; i++) {
+            hits.emplace_back(tmaxs[i], nullptr, Vector3f::ZERO);
+        }
+        traverseInterleaved(rays, hits.data(), results, count, tmin, width, [&](PrimitiveRef ref, const RayState &state) {
+            return occludedRef(ref, rays[state.ray], state.o, state.d, tmin, tmaxs[state.ray]);
+        }, true);
+    }
+
+    AABB getAABB() const override {
+        return nodes.empty() ? AABB() : nodes[0].box;
+    }
+
+    // Surface of a hit in a sphere or quad packet
+    void computeSurface(const Ray &r, Hit &h) const override {
+        int slot = h.getPrimitive() >> 1;
+        int lane = slot % PacketWidth;
+        if ((h.getPrimitive() & 1) == 0) {
+            const SpherePacket &packet = spherePackets[slot / PacketWidth];
+            Vector3f outwardNormal = (r.pointAtParameter(h.getT()) - packet.getCenter(lane)).normalized();
+            h.setSurface(materials[packet.material[lane]], outwardNormal);
+
+            float u, v;
+            Sphere::getUnitSphereUV(outwardNormal, u, v);
+            h.setUV(u, v);
+        } else {
+            const QuadPacket &packet = quadPackets[slot / PacketWidth];
+            h.setSurface(materials[packet.material[lane]], packet.getNormal(lane));
+        }
+    }
+
+    size_t getMemoryUsage() const override {
+        return sizeof(FlatBVH) + nodes.size() * sizeof(Node) + refs.size() * sizeof(PrimitiveRef)
+               + spherePackets.size() * sizeof(SpherePacket) + quadPackets.size() * sizeof(QuadPacket)
+               + materials.size() * sizeof(Material*) + triangles.size() * sizeof(Triangle)
+               + patches.size() * sizeof(BezierSurface) + others.size() * sizeof(Object3D*);
+    }
+
+    int getPrimitiveCount() const {
+        return primitiveCount;
+    }
+
+    // Fraction of the sphere and quad packet lanes that hold a primitive
+    float getPacketOccupancy() const {
+        int lanes = (int) (spherePackets.size() + quadPackets.size()) * PacketWidth;
+        int used = 0;
+        for (const SpherePacket &packet : spherePackets) {
+            for (int lane = 0; lane < PacketWidth; lane++) used += packet.isUsed(lane);
+        }
+        for (const QuadPacket &packet : quadPackets) {
+            for (int lane = 0; lane < PacketWidth; lane++) used += packet.isUsed(lane);
+        }
+        return lanes > 0 ? (float) used / lanes : 0;
+    }
+
+private:
+    static const int DefaultInterleaveWidth = 8;
+    static const int MaxInterleaveWidth = 32;
+
+    // Subtrees with at most this many primitives become a single leaf, so that the
+    // spheres or quads of a leaf always fit into one packet
+    static const int MaxLeafSize = PacketWidth;
+
+    enum PrimitiveType { SphereType, QuadType, TriangleType, PatchType, OtherType };
+
+    struct PrimitiveRef {
+        uint32_t type : 3;
+        uint32_t index : 29;
+    };
+
+    static const int PageSize = 4096;
+
+    struct Node {
+        AABB box;
+        int offset;         // first PrimitiveRef for leaves, left child for internal nodes, followed by the right one
+        uint16_t count;     // number of PrimitiveRefs, 0 for internal nodes
+        uint8_t axis;       // internal nodes: axis along which the children lie farthest apart
+        uint8_t leftAbove;  // whether the left child lies above the right one on that axis
+
+        // Whether a ray should visit the right child first, i.e. the one nearer to where it comes from
+        bool rightFirst(const Ray &r) const {
+            return r.getSign(axis) != leftAbove;
+        }
+    };
+
+    // Node 0 is the root, node 1 padding, so that every pair starts a cache line
+    std::vector<Node, AlignedAllocator<Node, PageSize>> nodes;
+    std::vector<PrimitiveRef> refs;
+    std::vector<SpherePacket> spherePackets;
+    std::vector<QuadPacket> quadPackets;
+    std::vector<Material*> materials;               // indexed by the material ids of packet lanes
+    std::unordered_map<Material*, uint32_t> materialIds;    // only while building
+    std::vector<Triangle> triangles;
+    std::vector<BezierSurface> patches;
+    std::vector<const Object3D*> others;
+    int primitiveCount = 0;
+
+    // Traversal of one ray in traverseInterleaved()
+    struct RayState {
+        int ray;            // index into the batch, -1 once the batch is used up
+        int node;           // node to visit next
+        int stack[64];
+        int top;
+        bool leafPending;   // the box of the leaf node was hit and its primitives prefetched
+        const float *o, *d;
+    };
+
+    static void prefetch(const void *data, size_t bytes) {
+        for (size_t offset = 0; offset < bytes; offset += 64) {
+            __builtin_prefetch((const char *) data + offset);
+        }
+    }
+
+    // Starts loading what intersectRef() and occludedRef() read for ref
+    void prefetchRef(PrimitiveRef ref) const {
+        switch (ref.type) {
+            case SphereType: prefetch(&spherePackets[ref.index], sizeof(SpherePacket)); break;
+            case QuadType: prefetch(&quadPackets[ref.index], sizeof(QuadPacket)); break;
+            case TriangleType: prefetch(&triangles[ref.index], sizeof(Triangle)); break;
+            case PatchType: prefetch(&patches[ref.index], sizeof(BezierSurface)); break;
+            default: prefetch(others[ref.index], 64); break;
+        }
+    }
+
+    // Hits in packets record (packet * PacketWidth + lane) * 2, plus 1 for quads
+    static int packetPrimitive(PrimitiveRef ref, int lane, bool quad) {
+        return (int) (ref.index * PacketWidth + lane) * 2 + quad;
+    }
+
+    // Tests a leaf entry against r, recording a closer hit in h
+    bool intersectRef(PrimitiveRef ref, const Ray &r, const float *o, const float *d, Hit &h, float tmin) const {
+        float t = h.getT();
+        int lane;
+        switch (ref.type) {
+            case SphereType:
+                lane = intersectSpherePacket(spherePackets[ref.index], o, d, tmin, t);
+                if (lane < 0) return false;
+                h.record(t, this, packetPrimitive(ref, lane, false));
+                return true;
+            case QuadType:
+                lane = intersectQuadPacket(quadPackets[ref.index], o, d, tmin, t);
+                if (lane < 0) return false;
+                h.record(t, this, packetPrimitive(ref, lane, true));
+                return true;
+            case TriangleType: return triangles[ref.index].Triangle::intersect(r, h, tmin);
+            case PatchType: return patches[ref.index].BezierSurface::intersect(r, h, tmin);
+            default: return others[ref.index]->intersect(r, h, tmin);
+        }
+    }
+
+    bool occludedRef(PrimitiveRef ref, const Ray &r, const float *o, const float *d, float tmin, float tmax) const {
+        float t = tmax;
+        switch (ref.type) {
+            case SphereType: return intersectSpherePacket(spherePackets[ref.index], o, d, tmin, t) >= 0;
+            case QuadType: return intersectQuadPacket(quadPackets[ref.index], o, d, tmin, t) >= 0;
+            case TriangleType: return triangles[ref.index].Triangle::occluded(r, tmin, tmax);
+            case PatchType: return patches[ref.index].BezierSurface::occluded(r, tmin, tmax);
+            default: return others[ref.index]->occluded(r, tmin, tmax);
+        }
+    }
+
+    // Boxes are culled against h.getT(). visit(node) is called for every node whose box is
+    // tested, leaf(ref) tests a primitive, and with anyHit the traversal ends at the first
+    // primitive that reports a hit.
+    template <typename Leaf, typename Visit>
+    bool traverse(const Ray &r, const Hit &h, float tmin, Leaf leaf, Visit visit, bool anyHit) const {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const float *o = &r.getOrigin()[0];
+        bool result = false;
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            int index = stack[--top];
+            const Node &node = nodes[index];
+            visit(node);
+            if (!node.box.intersect(o, r, tmin, h.getT())) continue;
+
+            if (node.count > 0) {
+                for (int i = node.offset; i < node.offset + node.count; i++) {
+                    result |= leaf(refs[i]);
+                    if (result && anyHit) return true;
+                }
+            } else if (node.rightFirst(r)) {
+                stack[top++] = node.offset;
+                stack[top++] = node.offset + 1;
+            } else {
+                stack[top++] = node.offset + 1;
+                stack[top++] = node.offset;
+            }
+        }
+        return result;
+    }
+
+    // Same traversal as traverse() for a batch of rays, advancing one node of each ray in
+    // flight in turn. Boxes are culled against hits[i].getT(), leaf(ref, state) tests a
+    // primitive against the ray of state.
+    template <typename Leaf>
+    void traverseInterleaved(const Ray *rays, const Hit *hits, bool *results, int count, float tmin, int width,
+                             Leaf leaf, bool anyHit) const {
+        std::fill(results, results + count, false);
+        if (nodes.empty()) {
+            return;
+        }
+
+        width = std::max(1, std::min(MaxInterleaveWidth, width));
+        RayState states[MaxInterleaveWidth];
+        int next = 0, active = 0;
+        auto start = [&](RayState &state) {
+            if (next == count) {
+                state.ray = -1;
+                return;
+            }
+            state.ray = next++;
+            state.node = 0;
+            state.top = 0;
+            state.leafPending = false;
+            state.o = &rays[state.ray].getOrigin()[0];
+            state.d = &rays[state.ray].getDirection()[0];
+            __builtin_prefetch(&nodes[0]);
+            active++;
+        };
+        for (int i = 0; i < width; i++) {
+            start(states[i]);
+        }
+
+        while (active > 0) {
+            for (int i = 0; i < width; i++) {
+                RayState &state = states[i];
+                if (state.ray < 0) continue;
+
+                const Ray &r = rays[state.ray];
+                const Node &node = nodes[state.node];
+                bool finished = false;
+                if (state.leafPending) {
+                    state.leafPending = false;
+                    for (int j = node.offset; j < node.offset + node.count; j++) {
+                        results[state.ray] |= leaf(refs[j], state);
+                        if (results[state.ray] && anyHit) {
+                            finished = true;
+                            break;
+                        }
+                    }
+                } else if (node.box.intersect(state.o, r, tmin, hits[state.ray].getT())) {
+                    if (node.count == 0) {
+                        int left = node.offset, right = node.offset + 1;
+                        bool rightFirst = node.rightFirst(r);
+                        state.stack[state.top++] = rightFirst ? left : right;
+                        state.node = rightFirst ? right : left;
+                        __builtin_prefetch(&nodes[state.node]);
+                    } else {
+                        // Test the leaf on the next turn, once its primitives arrived
+                        for (int j = node.offset; j < node.offset + node.count; j++) {
+                            prefetchRef(refs[j]);
+                        }
+                        state.leafPending = true;
+                    }
+                    continue;
+                }
+
+                if (finished || state.top == 0) {
+                    active--;
+                    start(state);
+                } else {
+                    state.node = state.stack[--state.top];
+                    __builtin_prefetch(&nodes[state.node]);
+                }
+            }
+        }
+    }
+
+    void build(const BVHNode *root, Layout layout) {
+        std::vector<Node> tree;
+        buildTree(root, tree);
+        nodes.reserve(tree.size() + 1);
+        nodes.push_back(tree[0]);
+        nodes.emplace_back();
+        nodes[1].offset = 0;
+        nodes[1].count = 0;
+        if (layout == DepthFirstLayout) {
+            layOutDepthFirst(tree, 0, 0);
+        } else {
+            layOutTreelets(tree);
+        }
+        materialIds = std::unordered_map<Material*, uint32_t>();
+    }
+
+    // Appends the children of tree[parent], which was copied to nodes[slot], as a pair.
+    // Returns the index of the left child.
+    int addChildren(const std::vector<Node> &tree, int parent, int slot) {
+        int pair = (int) nodes.size();
+        nodes[slot].offset = pair;
+        nodes.push_back(tree[parent + 1]);
+        nodes.push_back(tree[tree[parent].offset]);
+        return pair;
+    }
+
+    void layOutDepthFirst(const std::vector<Node> &tree, int parent, int slot) {
+        if (tree[parent].count > 0) return;
+        int pair = addChildren(tree, parent, slot);
+        layOutDepthFirst(tree, parent + 1, pair);
+        layOutDepthFirst(tree, tree[parent].offset, pair + 1);
+    }
+
+    void layOutTreelets(const std::vector<Node> &tree) {
+        // Internal node whose children are not laid out yet
+        struct Pending {
+            float area;
+            int parent;     // in tree
+            int slot;       // in nodes
+
+            bool operator<(const Pending &other) const {
+                return area < other.area;
+            }
+        };
+        auto push = [&](std::priority_queue<Pending> &queue, int parent, int slot) {
+            if (tree[parent].count == 0) {
+                queue.push({tree[parent].box.getSurfaceArea(), parent, slot});
+            }
+        };
+
+        const int pageNodes = PageSize / (int) sizeof(Node);
+        std::priority_queue<Pending> roots, treelet;
+        push(roots, 0, 0);
+        while (!roots.empty()) {
+            // Fill up the page the previous treelet ended in, or start a new one
+            int freePairs = (pageNodes - (int) nodes.size() % pageNodes) / 2;
+            treelet.push(roots.top());
+            roots.pop();
+            for (; freePairs > 0 && !treelet.empty(); freePairs--) {
+                Pending next = treelet.top();
+                treelet.pop();
+                int pair = addChildren(tree, next.parent, next.slot);
+                push(treelet, next.parent + 1, pair);
+                push(treelet, tree[next.parent].offset, pair + 1);
+            }
+            for (; !treelet.empty(); treelet.pop()) {
+                roots.push(treelet.top());
+            }
+        }
+    }
+
+    // Copies the hierarchy below object into tree depth first, with the left child of an
+    // internal node directly following it and the right child at offset
+    void buildTree(const Object3D *object, std::vector<Node> &tree) {
+        int index = (int) tree.size();
+        tree.emplace_back();
+        tree[index].box = object->getAABB();
+
+        std::vector<Object3D*> primitives;
+        auto bvhNode = dynamic_cast<const BVHNode*>(object);
+        if (bvhNode != nullptr) {
+            bvhNode->collectPrimitives(primitives);
+        } else {
+            primitives.push_back(const_cast<Object3D*>(object));
+        }
+
+        if (primitives.size() <= MaxLeafSize) {
+            tree[index].offset = (int) refs.size();
+            addLeaf(primitives);
+            tree[index].count = (uint16_t) (refs.size() - tree[index].offset);
+            tree[index].axis = 0;
+            tree[index].leftAbove = 0;
+            return;
+        }
+
+        buildTree(bvhNode->getLeft(), tree);
+        tree[index].offset = (int) tree.size();
+        tree[index].count = 0;
+        buildTree(bvhNode->getRight(), tree);
+
+        AABB left = bvhNode->getLeft()->getAABB(), right = bvhNode->getRight()->getAABB();
+        float largest = -1;
+        for (int axis = 0; axis < 3; axis++) {
+            float leftCenter = left.getAxis(axis).getMin() + left.getAxis(axis).getMax();
+            float rightCenter = right.getAxis(axis).getMin() + right.getAxis(axis).getMax();
+            if (std::fabs(leftCenter - rightCenter) > largest) {
+                largest = std::fabs(leftCenter - rightCenter);
+                tree[index].axis = (uint8_t) axis;
+                tree[index].leftAbove = leftCenter > rightCenter;
+            }
+        }
+    }
+
+    uint32_t getMaterialId(Material *material) {
+        auto inserted = materialIds.emplace(material, (uint32_t) materials.size());
+        if (inserted.second) {
+            materials.push_back(material);
+        }
+        return inserted.first->second;
+    }
+
+    void addLeaf(const std::vector<Object3D*> &primitives) {
+        int sphereLane = 0, quadLane = 0;
+        for (auto primitive : primitives) {
+            PrimitiveRef ref;
+            const std::type_info &type = typeid(*primitive);
+            if (type == typeid(Sphere) && !static_cast<const Sphere*>(primitive)->hasUVRotation()) {
+                if (sphereLane == 0) {
+                    ref.type = SphereType;
+                    ref.index = (uint32_t) spherePackets.size();
+                    refs.push_back(ref);
+                    spherePackets.emplace_back();
+                }
+                auto sphere = static_cast<const Sphere*>(primitive);
+                spherePackets.back().set(sphereLane++, sphere->getCenter(), sphere->getRadius(),
+                                         getMaterialId(sphere->material));
+            } else if (type == typeid(Quad)) {
+                if (quadLane == 0) {
+                    ref.type = QuadType;
+                    ref.index = (uint32_t) quadPackets.size();
+                    refs.push_back(ref);
+                    quadPackets.emplace_back();
+                }
+                auto quad = static_cast<const Quad*>(primitive);
+                quadPackets.back().set(quadLane++, quad->getCorner(), quad->getEdgeA(), quad->getEdgeB(),
+                                       quad->getNormal(), getMaterialId(quad->material));
+            } else if (type == typeid(Triangle)) {
+                ref.type = TriangleType;
+                ref.index = (uint32_t) triangles.size();
+                refs.push_back(ref);
+                triangles.push_back(*static_cast<const Triangle*>(primitive));
+            } else if (type == typeid(BezierSurface)) {
+                ref.type = PatchType;
+                ref.index = (uint32_t) patches.size();
+                refs.push_back(ref);
+                patches.push_back(*static_cast<const BezierSurface*>(primitive));
+            } else {
+                ref.type = OtherType;
+                ref.index = (uint32_t) others.size();
+                refs.push_back(ref);
+                others.push_back(primitive);
+            }
+            primitiveCount++;
+        }
+    }
+};
+
+#endif //RAYTRACING_FLAT_BVH_HPP
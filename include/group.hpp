@@ -11,6 +11,7 @@
 #include "hit.hpp"
 #include <iostream>
 #include <vector>
+#include <algorithm>
 
 
 class Group : public Object3D {
@@ -33,11 +34,32 @@ public:
         return hit;
     }
 
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        for (auto obj : objects) {
+            if (obj->occluded(r, tmin, tmax)) return true;
+        }
+        return false;
+    }
+
+    void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const override {
+        for (auto obj : objects) {
+            obj->getCrossings(r, crossings);
+        }
+    }
+
     void addObject(Object3D *obj) {
         objects.push_back(obj);
         aabb.expand(obj->getAABB());
     }
 
+    void removeObject(Object3D *obj) {
+        objects.erase(std::remove(objects.begin(), objects.end(), obj), objects.end());
+        aabb = AABB();
+        for (auto object : objects) {
+            aabb.expand(object->getAABB());
+        }
+    }
+
     int getGroupSize() {
         return objects.size();
     }
@@ -6,12 +6,21 @@
 #define HIT_H
 
 #include <vecmath.h>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
 #include "ray.hpp"
 
 class Material;
+class Object3D;
+class Instance;
 
+// Closest hit found so far. Primitives either set the surface (normal, material and
+// texture coordinates) right away, or only record where they were hit and compute the
+// surface once traversal has found the final hit (see computeHitSurface).
 class Hit {
 public:
+    static const int MaxInstanceDepth = 8;
 
     // constructors
     Hit() {
@@ -25,11 +34,7 @@ public:
         normal = n;
     }
 
-    Hit(const Hit &h) {
-        t = h.t;
-        material = h.material;
-        normal = h.normal;
-    }
+    Hit(const Hit &h) = default;
 
     // destructor
     ~Hit() = default;
@@ -54,10 +59,73 @@ public:
         return v;
     }
 
+    // Object that recorded the hit, nullptr if the surface was set right away
+    const Object3D *getObject() const {
+        return object;
+    }
+
+    int getPrimitive() const {
+        return primitive;
+    }
+
+    // Barycentric or parametric coordinates of the hit on the primitive
+    float getB1() const {
+        return b1;
+    }
+
+    float getB2() const {
+        return b2;
+    }
+
+    // Instances the hit lies in, innermost first
+    int getInstanceDepth() const {
+        return instanceDepth;
+    }
+
+    const Instance *getInstance(int i) const {
+        return instances[i];
+    }
+
     void set(float _t, Material *m, const Vector3f &n) {
         t = _t;
         material = m;
         normal = n;
+        object = nullptr;
+        instanceDepth = 0;
+    }
+
+    // Closer hit whose surface is left to object->computeSurface()
+    void record(float _t, const Object3D *o, int _primitive = -1, float _b1 = 0, float _b2 = 0) {
+        t = _t;
+        object = o;
+        primitive = _primitive;
+        b1 = _b1;
+        b2 = _b2;
+        instanceDepth = 0;
+    }
+
+    // Called by every instance the hit was found in, on the way out of traversal. Deeper
+    // nesting than MaxInstanceDepth would shade the hit in the wrong space.
+    void pushInstance(const Instance *instance) {
+        assert(instanceDepth < MaxInstanceDepth);
+        if (instanceDepth < MaxInstanceDepth) {
+            instances[instanceDepth++] = instance;
+        } else {
+            static std::atomic<bool> reported(false);
+            if (!reported.exchange(true)) {
+                printf("Instances nested deeper than %d levels are shaded without the outer ones\n",
+                       MaxInstanceDepth);
+            }
+        }
+    }
+
+    void setSurface(Material *m, const Vector3f &n) {
+        material = m;
+        normal = n;
+    }
+
+    void setNormal(const Vector3f &n) {
+        normal = n;
     }
 
     void setUV(float _u, float _v) {
@@ -69,7 +137,12 @@ private:
     float t;
     Material *material;
     Vector3f normal;
-    float u, v;     // texture coordinates
+    float u = 0, v = 0;     // texture coordinates
+    const Object3D *object = nullptr;
+    int primitive = -1;
+    float b1 = 0, b2 = 0;
+    const Instance *instances[MaxInstanceDepth] = {};
+    int instanceDepth = 0;
 };
 
 inline std::ostream &operator<<(std::ostream &os, const Hit &h) {
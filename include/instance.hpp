@@ -0,0 +1,191 @@
+//
+// Referencing PA1
+//
+#ifndef RAYTRACING_INSTANCE_HPP
+#define RAYTRACING_INSTANCE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vecmath.h>
+#include "object3d.hpp"
+
+#define DegreesToRadians(x) ((M_PI * x) / 180.0f)
+
+// Places shared geometry (e.g. a Mesh or a BVHNode over primitives, the bottom level)
+// in the scene without owning it, so many instances can reference the same geometry.
+// The scene BVH over the instances forms the top level. The instance takes the material of
+// the geometry, which is nullptr for a BVHNode: hits get theirs from the primitives, and
+// emissive primitives in it are not sampled as lights.
+class Instance : public Object3D {
+public:
+    Instance() = delete;
+
+    Instance(const Object3D *geometry, const Matrix4f &m) : o(geometry), Object3D(geometry->material) {
+        setMatrix(m);
+    }
+
+    Instance(const Object3D *geometry, const Vector3f &scale, const Vector3f &translate,
+             float rotateX, float rotateY, float rotateZ)
+        : o(geometry), Object3D(geometry->material) {
+        setMatrix(composeMatrix(scale, translate, rotateX, rotateY, rotateZ));
+    }
+
+    bool intersect(const Ray &r, Hit &h, float tmin) const override {
+        // Rays missing the instance never pay for the transformation
+        if (!newAABB.intersect(r, tmin, h.getT())) {
+            return false;
+        }
+
+        const Object3D *geometry = selectGeometry(r);
+        bool inter = geometry->intersect(toObject(r), h, tmin);
+        if (inter) {
+            h.pushInstance(this);
+        }
+        return inter;
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        if (!newAABB.intersect(r, tmin, tmax)) {
+            return false;
+        }
+
+        const Object3D *geometry = selectGeometry(r);
+        return geometry->occluded(toObject(r), tmin, tmax);
+    }
+
+    void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const override {
+        if (!newAABB.intersect(r, -MAXFLOAT, MAXFLOAT)) {
+            return;
+        }
+
+        const Object3D *geometry = selectGeometry(r);
+        geometry->getCrossings(toObject(r), crossings);
+    }
+
+    // The direction is not normalized, so t is the same in both spaces
+    Ray toObject(const Ray &r) const {
+        return Ray(worldToObject.transformPoint(r.getOrigin()), worldToObject.transformVector(r.getDirection()));
+    }
+
+    Vector3f normalToWorld(const Vector3f &normal) const {
+        return objectToWorld.transformNormal(normal).normalized();
+    }
+
+    AABB getAABB() const override {
+        return newAABB;
+    }
+
+    const Object3D *getGeometry() const {
+        return o;
+    }
+
+    // Trace each ray against coarse with probability blend and against fine otherwise, so that
+    // switching between two levels of detail of the geometry fades instead of popping. Both
+    // have to lie inside the bounds of the geometry (see Scene::selectLODs).
+    void setLOD(const Object3D *fine, const Object3D *coarse, float blend) {
+        this->fine = fine;
+        this->coarse = coarse;
+        this->blend = blend;
+    }
+
+    void clearLOD() {
+        fine = coarse = nullptr;
+        blend = 0;
+    }
+
+    Matrix4f getMatrix() const {
+        return objectToWorld.toMatrix4f();
+    }
+
+    // Move the object. The enclosing BVH has to be refitted afterwards (see Scene::updateScene).
+    void setMatrix(const Matrix4f &m) {
+        objectToWorld = Affine3f(m);
+        worldToObject = objectToWorld.inverse();
+
+        newAABB = AABB();
+        setNewAABB(o->getAABB());
+    }
+
+    void setMatrix(const Vector3f &scale, const Vector3f &translate, float rotateX, float rotateY, float rotateZ) {
+        setMatrix(composeMatrix(scale, translate, rotateX, rotateY, rotateZ));
+    }
+
+    static Matrix4f composeMatrix(const Vector3f &scale, const Vector3f &translate, float rotateX, float rotateY, float rotateZ) {
+        Matrix4f m = Matrix4f::identity();
+
+        m = m * Matrix4f::translation(translate);
+        m = m * Matrix4f::rotateX(DegreesToRadians(rotateX));
+        m = m * Matrix4f::rotateY(DegreesToRadians(rotateY));
+        m = m * Matrix4f::rotateZ(DegreesToRadians(rotateZ));
+        m = m * Matrix4f::scaling(scale.x(), scale.y(), scale.z());
+        return m;
+    }
+
+protected:
+    const Object3D *o; //un-transformed object
+    Affine3f objectToWorld;
+    Affine3f worldToObject;
+    AABB newAABB;
+    const Object3D *fine = nullptr;
+    const Object3D *coarse = nullptr;
+    float blend = 0;
+
+    // The geometry to trace r against: coarse with probability blend. The choice hashes the
+    // origin and direction of r rather than calling rand(), which takes a global lock, so it
+    // is the same every time the ray is traced.
+    const Object3D *selectGeometry(const Ray &r) const {
+        if (coarse == nullptr) {
+            return o;
+        }
+        const float *origin = &r.getOrigin()[0];
+        const float *direction = &r.getDirection()[0];
+        uint32_t bits[6];
+        memcpy(bits, origin, 3 * sizeof(float));
+        memcpy(bits + 3, direction, 3 * sizeof(float));
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t word : bits) {
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        // Final mix of MurmurHash3, so that nearby rays get unrelated values
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return (hash >> 40) * (1.0f / (1 << 24)) < blend ? coarse : fine;
+    }
+
+    void setNewAABB(const AABB &aabb) {
+        Vector3f min = aabb.getMin(), max = aabb.getMax();
+        Vector3f vertices[8] = {
+                Vector3f(min.x(), min.y(), min.z()),
+                Vector3f(min.x(), min.y(), max.z()),
+                Vector3f(min.x(), max.y(), min.z()),
+                Vector3f(min.x(), max.y(), max.z()),
+                Vector3f(max.x(), min.y(), min.z()),
+                Vector3f(max.x(), min.y(), max.z()),
+                Vector3f(max.x(), max.y(), min.z()),
+                Vector3f(max.x(), max.y(), max.z())
+        };
+        for (auto & vertex : vertices) {
+            vertex = objectToWorld.transformPoint(vertex);
+            newAABB.expand(vertex);
+        }
+    }
+};
+
+// Completes the closest hit of r after traversal: the object that recorded it computes
+// the surface in its own space, and the normal is carried out through the instances.
+inline void computeHitSurface(const Ray &r, Hit &h) {
+    const Object3D *object = h.getObject();
+    if (object != nullptr) {
+        Ray objectRay = r;
+        for (int i = h.getInstanceDepth() - 1; i >= 0; i--) {
+            objectRay = h.getInstance(i)->toObject(objectRay);
+        }
+        object->computeSurface(objectRay, h);
+    }
+    for (int i = 0; i < h.getInstanceDepth(); i++) {
+        h.setNormal(h.getInstance(i)->normalToWorld(h.getNormal()));
+    }
+}
+
+#endif //RAYTRACING_INSTANCE_HPP
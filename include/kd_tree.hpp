@@ -0,0 +1,282 @@
+//
+// Implemented independently
+//
+// Referencing Pharr, Jakob and Humphreys, "Physically Based Rendering", 3rd edition, 4.4
+//
+
+#ifndef RAYTRACING_KD_TREE_HPP
+#define RAYTRACING_KD_TREE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "accelerator.hpp"
+
+// Kd-tree whose split planes minimize the surface area heuristic. Unlike a BVH, children
+// never overlap, so a ray visits the nodes it pierces strictly front to back and stops in
+// the first node that contains the closest hit. Objects straddling a plane are listed on
+// both sides.
+class KdTree : public Accelerator {
+public:
+    KdTree() = delete;
+
+    explicit KdTree(const std::vector<Object3D*> &objects) {
+        build(objects);
+    }
+
+    bool intersect(const Ray &r, Hit &h, float tmin) const override {
+        return traverse(r, h, tmin, [&](const Object3D *object) {
+            return object->intersect(r, h, tmin);
+        }, false);
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        Hit h(tmax, nullptr, Vector3f::ZERO);
+        return traverse(r, h, tmin, [&](const Object3D *object) {
+            return object->occluded(r, tmin, tmax);
+        }, true);
+    }
+
+    AABB getAABB() const override {
+        return aabb;
+    }
+
+    size_t getMemoryUsage() const override {
+        return sizeof(KdTree) + nodes.size() * sizeof(Node) + leafObjects.size() * sizeof(Object3D*)
+               + unbounded.size() * sizeof(Object3D*);
+    }
+
+    int getNodeCount() const {
+        return (int) nodes.size();
+    }
+
+    // Sum over all leaves of the objects listed in them
+    int getReferenceCount() const {
+        return (int) leafObjects.size();
+    }
+
+private:
+    static constexpr float TraversalCost = 1.0f;
+    static constexpr float IntersectionCost = 80.0f;
+    static constexpr float EmptyBonus = 0.5f;
+    static const int MaxLeafSize = 1;
+    static const int MaxBadRefines = 3;
+    static const int MaxDepth = 48;
+
+    static const uint32_t LeafAxis = 3;
+
+    // Laid out depth first: the child below the split plane directly follows its parent
+    struct Node {
+        union {
+            float split;        // internal nodes
+            int offset;         // leaves: first object in leafObjects
+        };
+        uint32_t bits;          // low 2 bits: split axis or LeafAxis, the rest: child above the plane or object count
+
+        uint32_t getAxis() const { return bits & 3; }
+        uint32_t getValue() const { return bits >> 2; }
+    };
+
+    struct Edge {
+        float t;
+        int object;
+        bool start;
+
+        bool operator<(const Edge &other) const {
+            if (t != other.t) return t < other.t;
+            return start && !other.start;
+        }
+    };
+
+    std::vector<Node> nodes;
+    std::vector<const Object3D*> leafObjects;
+    std::vector<const Object3D*> unbounded;
+    AABB bounds;        // of the objects in the tree
+    AABB aabb;          // including the unbounded ones
+
+    // Nodes are culled against h.getT(). leaf(object) tests an object, and with anyHit the
+    // traversal ends at the first object that reports a hit.
+    template <typename Leaf>
+    bool traverse(const Ray &r, const Hit &h, float tmin, Leaf leaf, bool anyHit) const {
+        bool result = false;
+        for (auto object : unbounded) {
+            result |= leaf(object);
+            if (result && anyHit) return true;
+        }
+        if (nodes.empty()) {
+            return result;
+        }
+
+        const float *o = &r.getOrigin()[0];
+        const float *d = &r.getDirection()[0];
+        const float *invD = r.getInvDirection();
+
+        float t0 = tmin, t1 = h.getT();
+        for (int axis = 0; axis < 3; axis++) {
+            Interval interval = bounds.getAxis(axis);
+            float tNear = ((r.getSign(axis) ? interval.getMax() : interval.getMin()) - o[axis]) * invD[axis];
+            float tFar = ((r.getSign(axis) ? interval.getMin() : interval.getMax()) - o[axis]) * invD[axis];
+            t0 = tNear > t0 ? tNear : t0;
+            t1 = tFar < t1 ? tFar : t1;
+        }
+        if (t0 > t1) {
+            return result;
+        }
+
+        struct Entry {
+            int node;
+            float t0, t1;
+        };
+        Entry stack[MaxDepth + 1];
+        int top = 0;
+        int index = 0;
+        while (true) {
+            // A hit before this node beats everything in it and behind it
+            if (h.getT() < t0) break;
+
+            const Node &node = nodes[index];
+            uint32_t axis = node.getAxis();
+            if (axis != LeafAxis) {
+                float tPlane = (node.split - o[axis]) * invD[axis];
+                bool belowFirst = o[axis] < node.split || (o[axis] == node.split && d[axis] <= 0);
+                int first = belowFirst ? index + 1 : (int) node.getValue();
+                int second = belowFirst ? (int) node.getValue() : index + 1;
+
+                // A ray parallel to the plane (NaN or infinite tPlane) stays on its side
+                if (!(tPlane <= t1) || tPlane <= 0) {
+                    index = first;
+                } else if (tPlane < t0) {
+                    index = second;
+                } else {
+                    stack[top++] = {second, tPlane, t1};
+                    index = first;
+                    t1 = tPlane;
+                }
+                continue;
+            }
+
+            int count = (int) node.getValue();
+            for (int i = node.offset; i < node.offset + count; i++) {
+                result |= leaf(leafObjects[i]);
+                if (result && anyHit) return true;
+            }
+            if (top == 0) break;
+            top--;
+            index = stack[top].node;
+            t0 = stack[top].t0;
+            t1 = stack[top].t1;
+        }
+        return result;
+    }
+
+    void build(const std::vector<Object3D*> &objects) {
+        std::vector<const Object3D*> bounded;
+        std::vector<AABB> boxes;
+        for (auto object : objects) {
+            AABB box = object->getAABB();
+            aabb.expand(box);
+            if (isBounded(box)) {
+                bounded.push_back(object);
+                boxes.push_back(box);
+                bounds.expand(box);
+            } else {
+                unbounded.push_back(object);
+            }
+        }
+        if (bounded.empty()) {
+            return;
+        }
+
+        std::vector<int> ids(bounded.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            ids[i] = (int) i;
+        }
+        int maxDepth = std::min(MaxDepth, (int) std::round(8 + 1.3f * std::log2((float) bounded.size())));
+        buildNode(bounded, boxes, bounds, ids, maxDepth, 0);
+    }
+
+    void makeLeaf(int index, const std::vector<const Object3D*> &objects, const std::vector<int> &ids) {
+        nodes[index].offset = (int) leafObjects.size();
+        nodes[index].bits = LeafAxis | ((uint32_t) ids.size() << 2);
+        for (int id : ids) {
+            leafObjects.push_back(objects[id]);
+        }
+    }
+
+    void buildNode(const std::vector<const Object3D*> &objects, const std::vector<AABB> &boxes, const AABB &box,
+                   const std::vector<int> &ids, int depth, int badRefines) {
+        int index = (int) nodes.size();
+        nodes.emplace_back();
+        if ((int) ids.size() <= MaxLeafSize || depth == 0) {
+            makeLeaf(index, objects, ids);
+            return;
+        }
+
+        // Sweep the sorted bounds of the objects on every axis, longest first, for the cheapest plane
+        float totalArea = box.getSurfaceArea();
+        float invTotalArea = totalArea > 0 ? 1 / totalArea : 0;
+        float leafCost = IntersectionCost * ids.size();
+        float bestCost = MAXFLOAT;
+        int bestAxis = -1, bestEdge = -1;
+        std::vector<Edge> edges[3];
+        int axis = box.getLongestAxis();
+        for (int tries = 0; tries < 3 && bestAxis == -1; tries++, axis = (axis + 1) % 3) {
+            edges[axis].clear();
+            for (int id : ids) {
+                edges[axis].push_back({boxes[id].getAxis(axis).getMin(), id, true});
+                edges[axis].push_back({boxes[id].getAxis(axis).getMax(), id, false});
+            }
+            std::sort(edges[axis].begin(), edges[axis].end());
+
+            Interval range = box.getAxis(axis);
+            float extent[3] = {box.getX().getLength(), box.getY().getLength(), box.getZ().getLength()};
+            float otherA = extent[(axis + 1) % 3], otherB = extent[(axis + 2) % 3];
+            int below = 0, above = (int) ids.size();
+            for (int i = 0; i < (int) edges[axis].size(); i++) {
+                const Edge &edge = edges[axis][i];
+                if (!edge.start) above--;
+                if (edge.t > range.getMin() && edge.t < range.getMax()) {
+                    float belowArea = 2 * (otherA * otherB + (edge.t - range.getMin()) * (otherA + otherB));
+                    float aboveArea = 2 * (otherA * otherB + (range.getMax() - edge.t) * (otherA + otherB));
+                    float bonus = (below == 0 || above == 0) ? EmptyBonus : 0;
+                    float cost = TraversalCost + IntersectionCost * (1 - bonus)
+                                 * (belowArea * invTotalArea * below + aboveArea * invTotalArea * above);
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestEdge = i;
+                    }
+                }
+                if (edge.start) below++;
+            }
+        }
+
+        // Splits costlier than a leaf are tolerated a few times, as later ones may pay off
+        if (bestCost > leafCost) badRefines++;
+        if (bestAxis == -1 || (bestCost > 4 * leafCost && ids.size() < 16) || badRefines == MaxBadRefines) {
+            makeLeaf(index, objects, ids);
+            return;
+        }
+
+        const std::vector<Edge> &sorted = edges[bestAxis];
+        float split = sorted[bestEdge].t;
+        std::vector<int> belowIds, aboveIds;
+        for (int i = 0; i < bestEdge; i++) {
+            if (sorted[i].start) belowIds.push_back(sorted[i].object);
+        }
+        for (int i = bestEdge + 1; i < (int) sorted.size(); i++) {
+            if (!sorted[i].start) aboveIds.push_back(sorted[i].object);
+        }
+
+        Vector3f belowMax = box.getMax(), aboveMin = box.getMin();
+        belowMax[bestAxis] = split;
+        aboveMin[bestAxis] = split;
+        buildNode(objects, boxes, AABB(box.getMin(), belowMax), belowIds, depth - 1, badRefines);
+        nodes[index].split = split;
+        nodes[index].bits = (uint32_t) bestAxis | ((uint32_t) nodes.size() << 2);
+        buildNode(objects, boxes, AABB(aboveMin, box.getMax()), aboveIds, depth - 1, badRefines);
+    }
+};
+
+#endif //RAYTRACING_KD_TREE_HPP
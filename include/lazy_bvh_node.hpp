@@ -0,0 +1,143 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_LAZY_BVH_NODE_HPP
+#define RAYTRACING_LAZY_BVH_NODE_HPP
+
+#include <atomic>
+#include <vector>
+#include "accelerator.hpp"
+
+// BVH node that is only split the first time a ray reaches it.
+// Exactly one thread builds a node; the other threads arriving in the meantime
+// test the node's objects linearly instead of waiting for the split.
+class LazyBVHNode : public Accelerator {
+public:
+    LazyBVHNode() = delete;
+
+    explicit LazyBVHNode(std::vector<Object3D*> objects)
+            : objects(std::move(objects)), left(nullptr), right(nullptr) {
+        aabb = AABB();
+        for (auto object : this->objects) {
+            aabb.expand(object->getAABB());
+        }
+        state = this->objects.size() <= LeafSize ? Leaf : Unbuilt;
+    }
+
+    ~LazyBVHNode() override {
+        delete left;
+        delete right;
+    }
+
+    bool intersect(const Ray &r, Hit &h, float tmin) const override {
+        if (!aabb.intersect(r, tmin, h.getT())) {
+            return false;
+        }
+
+        int current = state.load(std::memory_order_acquire);
+        if (current == Unbuilt) {
+            split();
+            current = state.load(std::memory_order_acquire);
+        }
+        if (current != Built) {
+            bool hit = false;
+            for (auto object : objects) {
+                hit |= object->intersect(r, h, tmin);
+            }
+            return hit;
+        }
+
+        bool hit_left = left->intersect(r, h, tmin);
+        bool hit_right = right->intersect(r, h, tmin);
+        return hit_left || hit_right;
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        if (!aabb.intersect(r, tmin, tmax)) {
+            return false;
+        }
+
+        int current = state.load(std::memory_order_acquire);
+        if (current == Unbuilt) {
+            split();
+            current = state.load(std::memory_order_acquire);
+        }
+        if (current != Built) {
+            for (auto object : objects) {
+                if (object->occluded(r, tmin, tmax)) return true;
+            }
+            return false;
+        }
+        return left->occluded(r, tmin, tmax) || right->occluded(r, tmin, tmax);
+    }
+
+    void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const override {
+        if (!aabb.intersect(r, -MAXFLOAT, MAXFLOAT)) {
+            return;
+        }
+
+        int current = state.load(std::memory_order_acquire);
+        if (current == Unbuilt) {
+            split();
+            current = state.load(std::memory_order_acquire);
+        }
+        if (current != Built) {
+            for (auto object : objects) {
+                object->getCrossings(r, crossings);
+            }
+            return;
+        }
+        left->getCrossings(r, crossings);
+        right->getCrossings(r, crossings);
+    }
+
+    AABB getAABB() const override {
+        return aabb;
+    }
+
+    // Grows as nodes are split
+    size_t getMemoryUsage() const override {
+        size_t bytes = sizeof(LazyBVHNode) + objects.capacity() * sizeof(Object3D*);
+        if (state.load(std::memory_order_acquire) == Built) {
+            bytes += left->getMemoryUsage() + right->getMemoryUsage();
+        }
+        return bytes;
+    }
+
+    // Number of nodes split so far in this subtree
+    int getBuiltNodeCount() const {
+        if (state.load(std::memory_order_acquire) != Built) return 0;
+        return 1 + left->getBuiltNodeCount() + right->getBuiltNodeCount();
+    }
+
+private:
+    enum State { Unbuilt, Building, Built, Leaf };
+    static const size_t LeafSize = 2;
+
+    // Kept after splitting, since other threads may still be iterating over it
+    std::vector<Object3D*> objects;
+    AABB aabb;
+    mutable std::atomic<int> state;
+    mutable LazyBVHNode *left;
+    mutable LazyBVHNode *right;
+
+    void split() const {
+        int expected = Unbuilt;
+        if (!state.compare_exchange_strong(expected, Building, std::memory_order_acq_rel)) {
+            return;
+        }
+
+        std::vector<Object3D*> sorted(objects);
+        int axis = aabb.getLongestAxis();
+        std::sort(sorted.begin(), sorted.end(), [&axis](Object3D *a, Object3D *b) {
+            return a->getAABB().getAxis(axis).getMax() < b->getAABB().getAxis(axis).getMax();
+        });
+
+        left = new LazyBVHNode(std::vector<Object3D*>(sorted.begin(), sorted.begin() + sorted.size() / 2));
+        right = new LazyBVHNode(std::vector<Object3D*>(sorted.begin() + sorted.size() / 2, sorted.end()));
+        state.store(Built, std::memory_order_release);
+    }
+};
+
+#endif //RAYTRACING_LAZY_BVH_NODE_HPP
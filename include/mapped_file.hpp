@@ -0,0 +1,122 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_MAPPED_FILE_HPP
+#define RAYTRACING_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+// Empty files are open but have no data.
+class MappedFile {
+public:
+    MappedFile() = delete;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    explicit MappedFile(const char *filename) : data(nullptr), size(0), modificationTime(0), open(false) {
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat status;
+        if (fstat(fd, &status) == 0) {
+            size = (size_t) status.st_size;
+            modificationTime = (int64_t) status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+            if (size == 0) {
+                open = true;
+            } else {
+                void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED) {
+                    data = (const char *) mapped;
+                    open = true;
+                }
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap((void *) data, size);
+        }
+    }
+
+    bool isOpen() const {
+        return open;
+    }
+
+    const char *getData() const {
+        return data;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+    // Nanoseconds since the epoch
+    int64_t getModificationTime() const {
+        return modificationTime;
+    }
+
+    // Hint that the file will be read front to back once
+    void adviseSequential() const {
+        if (data != nullptr) {
+            madvise((void *) data, size, MADV_SEQUENTIAL);
+        }
+    }
+
+    // Starts reading [offset, offset + bytes) in the background. offset must be page aligned.
+    void prefetch(size_t offset, size_t bytes) const {
+        madvise((void *) (data + offset), bytes, MADV_WILLNEED);
+    }
+
+    // Drops the pages of [offset, offset + bytes) from this process. Since the mapping is
+    // never written, they are read from the file again on the next access, so this is safe
+    // even while other threads use them. offset must be page aligned.
+    void release(size_t offset, size_t bytes) const {
+        madvise((void *) (data + offset), bytes, MADV_DONTNEED);
+    }
+
+    // 64 bit FNV-1a of the contents, over 8 byte words instead of single bytes
+    uint64_t getContentHash() const {
+        uint64_t hash = 14695981039346656037ull;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        for (; i < size; i++) {
+            hash = (hash ^ (unsigned char) data[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Overwrites count bytes at offset of the file in place, e.g. a field of its header.
+    // Existing mappings of the file may or may not see the change.
+    static bool patch(const char *filename, size_t offset, const void *bytes, size_t count) {
+        int fd = ::open(filename, O_WRONLY);
+        if (fd < 0) {
+            return false;
+        }
+        bool written = pwrite(fd, bytes, count, (off_t) offset) == (ssize_t) count;
+        close(fd);
+        return written;
+    }
+
+private:
+    const char *data;
+    size_t size;
+    int64_t modificationTime;
+    bool open;
+};
+
+#endif //RAYTRACING_MAPPED_FILE_HPP
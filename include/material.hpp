@@ -19,11 +19,11 @@ class Object3D;
 
 const float rayEpsilon = 0.0001f;
 
-static Vector3f reflect(const Vector3f &v, const Vector3f &n) {
+inline Vector3f reflect(const Vector3f &v, const Vector3f &n) {
     return v - 2 * Vector3f::dot(v, n) * n;
 }
 
-static bool refract(const Vector3f &v, const Vector3f &n, float niOverNt, Vector3f &refracted) {
+inline bool refract(const Vector3f &v, const Vector3f &n, float niOverNt, Vector3f &refracted) {
     Vector3f uv = v.normalized();
     float dt = Vector3f::dot(uv, n);
     float discriminant = 1.0f - niOverNt * niOverNt * (1.0f - dt * dt);
@@ -35,7 +35,7 @@ static bool refract(const Vector3f &v, const Vector3f &n, float niOverNt, Vector
     }
 }
 
-static float schlick(float cosine, float refractiveIndex) {
+inline float schlick(float cosine, float refractiveIndex) {
     float r0 = (1 - refractiveIndex) / (1 + refractiveIndex);
     r0 = r0 * r0;
     return r0 + (1 - r0) * pow((1 - cosine), 5);
@@ -4,9 +4,16 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <string>
 #include <vector>
 #include "object3d.hpp"
 #include "triangle.hpp"
+#include "triangle_packet.hpp"
+#include "array_span.hpp"
+#include "mapped_file.hpp"
 #include "Vector2f.h"
 #include "Vector3f.h"
 
@@ -14,31 +21,260 @@
 class Mesh : public Object3D {
 
 public:
-    Mesh(const char *filename, Material *m);
+    // With useCache, the geometry and BVH are mapped from filename + ".meshcache" if that
+    // cache is up to date, and the cache is (re)written after parsing the OBJ otherwise.
+    Mesh(const char *filename, Material *m, bool useCache = true);
+
+    // Copies point their views at their own storage, unless the geometry is mapped
+    Mesh(const Mesh &other);
+    Mesh &operator=(const Mesh &other);
 
     struct TriangleIndex {
         TriangleIndex() {
             x[0] = 0; x[1] = 0; x[2] = 0;
         }
         int &operator[](const int i) { return x[i]; }
+        int operator[](const int i) const { return x[i]; }
         // By Computer Graphics convention, counterclockwise winding is front face
         int x[3]{};
     };
 
-    std::vector<Vector3f> v;
-    std::vector<TriangleIndex> t;
-    std::vector<Vector3f> n;
+    // Mesh over the given geometry, e.g. a simplified level of detail
+    Mesh(const std::vector<Vector3f> &vertices, const std::vector<TriangleIndex> &triangles, Material *m);
+
+    // Views of the geometry, which is either owned by the mesh or mapped from the cache file
+    ArraySpan<Vector3f> v;
+    ArraySpan<TriangleIndex> t;
+    ArraySpan<Vector3f> n;
+    // Texture coordinates and vertex normals with their own per-corner indices.
+    // tUV and tN are empty if the file has no vt or vn, corners without one are -1.
+    ArraySpan<Vector2f> uv;
+    ArraySpan<Vector3f> vn;
+    ArraySpan<TriangleIndex> tUV;
+    ArraySpan<TriangleIndex> tN;
+
     bool intersect(const Ray &r, Hit &h, float tmin) const override;
 
+    bool occluded(const Ray &r, float tmin, float tmax) const override;
+
+    // All triangles the line of r crosses, found in one traversal without culling by distance.
+    // Rays enter through the front (counterclockwise) faces.
+    void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const override;
+
+    // Paged meshes set the surface during traversal, since the cluster of the hit may be
+    // evicted by then
+    void computeSurface(const Ray &r, Hit &h) const override;
+
     AABB getAABB() const override {
         return aabb;
     }
 
+    Object3D *transformed(const Matrix4f &m) const override;
+
+    bool isMapped() const {
+        return cache != nullptr;
+    }
+
+    // Switches to the compact representation: positions quantized to 16 bits inside the
+    // mesh bounds and sorted along a Morton curve, 16 bit indices for up to 65536 vertices,
+    // octahedral normals and triangles in BVH leaf order. The BVH is rebuilt over the
+    // quantized positions. Afterwards v, t, n and vn are empty.
+    void compact();
+
+    bool isCompact() const {
+        return compactData != nullptr;
+    }
+
+    // Switches to paged geometry: the BVH is cut into clusters of subtrees, written with their
+    // triangle packets to filename + ".meshpages" (unless that file is up to date) and mapped
+    // from there. Only the nodes above the clusters stay in memory; a cluster is faulted in
+    // when a ray reaches it, and the least recently used ones are dropped again while the
+    // resident clusters exceed residencyBudget bytes. Paged meshes have no v, t, n, uv or vn
+    // (hits get the face normal) and cannot be transformed. Returns false if the mesh was not
+    // loaded from a file or is compact.
+    bool page(size_t residencyBudget);
+
+    bool isPaged() const {
+        return paging != nullptr;
+    }
+
+    struct PagingStatistics {
+        long pageIns = 0;           // clusters made resident
+        long evictions = 0;         // clusters dropped to stay within the budget
+        size_t residentBytes = 0;
+        size_t budget = 0;
+    };
+
+    // Counters since the last reset, e.g. per rendering pass
+    PagingStatistics getPagingStatistics() const;
+    void resetPagingStatistics();
+
+    // Simplifies the mesh into up to levels coarser meshes by quadric error edge collapses,
+    // each with half the triangles of the previous one. Collapses never move vertices out of
+    // the bounds of this mesh. Texture coordinates and vertex normals are not kept.
+    void buildLODs(int levels);
+
+    // Number of levels including this mesh, which is level 0
+    int getLODCount() const {
+        return 1 + (int) lods.size();
+    }
+
+    const Mesh *getLOD(int level) const;
+
+    // Largest distance between the surfaces of this level (or a finer one) and level 0, in
+    // object space: the Hausdorff distance, sampled at the vertices of both surfaces
+    float getLODError(int level) const;
+
+    // Distance from p to the closest triangle, MAXFLOAT for paged or empty meshes
+    float getDistance(const Vector3f &p) const;
+
+    // Bytes of geometry and BVH data
+    size_t getMemoryUsage() const;
+
 private:
 
+    // Node of the per-mesh BVH, laid out depth first: the left child of an internal
+    // node directly follows it, the right child is at offset.
+    struct BVHNode {
+        float min[3], max[3];
+        int offset;     // triangle packet (compact: first triangle) for leaves, right child for internal nodes
+        int count;      // number of triangles, 0 for internal nodes
+    };
+
+    // Every leaf fits into a single packet
+    static const int MaxLeafSize = TrianglePacketWidth;
+    static const int BinCount = 12;
+    // Below this depth splits fall back to the median, which bounds the traversal stack
+    static const int MaxSAHDepth = 32;
+
+    ArraySpan<BVHNode> nodes;
+    ArraySpan<TrianglePacket> packets;
+    ArraySpan<int> packetTriangles;         // packet * TrianglePacketWidth + lane, -1 for padding
+
+    // Backing arrays of the spans above, unused while the mesh is mapped
+    struct Storage {
+        std::vector<Vector3f> v;
+        std::vector<TriangleIndex> t;
+        std::vector<Vector3f> n;
+        std::vector<Vector2f> uv;
+        std::vector<Vector3f> vn;
+        std::vector<TriangleIndex> tUV;
+        std::vector<TriangleIndex> tN;
+        std::vector<BVHNode> nodes;
+        std::vector<TrianglePacket> packets;
+        std::vector<int> packetTriangles;
+    } storage;
+    std::shared_ptr<MappedFile> cache;
+
+    // Replaces v, t, n, vn, packets and packetTriangles after compact()
+    struct Compact {
+        float origin[3];
+        float scale[3];
+        std::vector<uint16_t> vertices;         // 3 per vertex
+        std::vector<uint16_t> indices16;        // 3 per triangle, if there are at most 65536 vertices
+        std::vector<uint32_t> indices32;        // otherwise
+        std::vector<uint32_t> normals;          // octahedral, per triangle
+        std::vector<uint32_t> vertexNormals;    // octahedral, indexed by tN
+
+        Vector3f getVertex(int i) const {
+            return Vector3f(origin[0] + vertices[3 * i] * scale[0],
+                            origin[1] + vertices[3 * i + 1] * scale[1],
+                            origin[2] + vertices[3 * i + 2] * scale[2]);
+        }
+
+        int getIndex(int triId, int corner) const {
+            return indices16.empty() ? (int) indices32[3 * triId + corner] : indices16[3 * triId + corner];
+        }
+    };
+    std::shared_ptr<const Compact> compactData;
+
+    std::string sourcePath;
+    std::vector<std::shared_ptr<const Mesh>> lods;
+    std::vector<float> lodErrors;
+    struct Paging;
+    std::shared_ptr<Paging> paging;
+
+    void bindStorage();
+    // Copies mapped arrays into storage, so that they can be modified
+    void copyToStorage();
+    // Decodes the compact arrays back into storage
+    void expandCompact();
+    void decodeLeaf(const BVHNode &node, TrianglePacket &packet) const;
+    bool intersectPaged(const Ray &r, Hit &h, float tmin) const;
+    bool occludedPaged(const Ray &r, float tmin, float tmax) const;
+    void getCrossingsPaged(const Ray &r, std::vector<Crossing> &crossings) const;
+    static void addCrossings(const TrianglePacket &packet, int count, const Vector3f &o, const Vector3f &d,
+                             std::vector<Crossing> &crossings);
+    bool openPages(const std::string &path, const MappedFile &source);
+    void writePages(const std::string &path, const MappedFile &source) const;
+    bool loadCache(const std::string &path, const MappedFile &source);
+    void writeCache(const std::string &path, const MappedFile &source) const;
+
     // Normal can be used for light estimation
     void computeNormal();
+    void computeAABB();
+    void buildBVH();
+    int buildNode(std::vector<int> &ids, std::vector<AABB> &boxes, std::vector<Vector3f> &centroids,
+                  std::vector<int> &leafTriangles, int begin, int end, int depth);
+    void interpolate(int triId, float b1, float b2, Hit &h) const;
     AABB aabb;
+
+    // Closest hit traversal of a node array laid out like nodes. leaf(node) tests the
+    // triangles of a leaf, updating h, and returns whether one of them was hit. With anyHit
+    // the traversal ends at the first leaf that reports a hit.
+    template <typename Leaf>
+    static bool traverse(const BVHNode *nodes, const Ray &r, const Hit &h, float tmin, Leaf leaf,
+                         bool anyHit = false);
 };
 
+template <typename Leaf>
+bool Mesh::traverse(const BVHNode *nodes, const Ray &r, const Hit &h, float tmin, Leaf leaf, bool anyHit) {
+    const float *o = &r.getOrigin()[0];
+    const float *invD = r.getInvDirection();
+
+    // Entry distance of the ray into a node, or MAXFLOAT if the node is missed
+    auto enter = [&](const BVHNode &node) {
+        float t1 = tmin, t2 = h.getT();
+        for (int i = 0; i < 3; i++) {
+            float tNear = ((r.getSign(i) ? node.max : node.min)[i] - o[i]) * invD[i];
+            float tFar = ((r.getSign(i) ? node.min : node.max)[i] - o[i]) * invD[i];
+            t1 = tNear > t1 ? tNear : t1;
+            t2 = tFar < t2 ? tFar : t2;
+        }
+        return t1 <= t2 ? t1 : MAXFLOAT;
+    };
+
+    bool result = false;
+    int stack[64];
+    int top = 0;
+    int index = enter(nodes[0]) < MAXFLOAT ? 0 : -1;
+    while (index >= 0 || top > 0) {
+        if (index < 0) {
+            index = stack[--top];
+        }
+        const BVHNode &node = nodes[index];
+        if (node.count > 0) {
+            result |= leaf(node);
+            if (result && anyHit) return true;
+            index = -1;
+            continue;
+        }
+
+        // Visit the nearer child first, so that the farther one can be culled more often
+        int left = index + 1, right = node.offset;
+        float tLeft = enter(nodes[left]), tRight = enter(nodes[right]);
+        if (tLeft > tRight) {
+            std::swap(left, right);
+            std::swap(tLeft, tRight);
+        }
+        if (tLeft == MAXFLOAT) {
+            index = -1;
+        } else {
+            index = left;
+            if (tRight < MAXFLOAT) stack[top++] = right;
+        }
+    }
+    return result;
+}
+
 #endif
@@ -0,0 +1,36 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_OBJ_LOADER_HPP
+#define RAYTRACING_OBJ_LOADER_HPP
+
+#include <cstddef>
+#include <vector>
+#include "Vector2f.h"
+#include "Vector3f.h"
+
+// Contents of a Wavefront OBJ file. Polygons are fan triangulated, so corners holds
+// three entries per triangle. All indices are 0 based, -1 marks a missing vt or vn.
+struct ObjData {
+    struct Corner {
+        int position;
+        int texcoord;
+        int normal;
+    };
+
+    std::vector<Vector3f> positions;
+    std::vector<Vector2f> texcoords;
+    std::vector<Vector3f> normals;
+    std::vector<Corner> corners;
+
+    size_t bytes = 0;       // size of the file
+    double seconds = 0;     // time spent mapping and parsing it
+};
+
+// Memory maps the file and parses it in chunks on all hardware threads
+// (or the given number of threads). Only v, vt, vn and f lines are read.
+// Prints an error and returns false if the file cannot be read or an index is invalid.
+bool loadObj(const char *filename, ObjData &data, int threads = 0);
+
+#endif //RAYTRACING_OBJ_LOADER_HPP
@@ -4,11 +4,22 @@
 #ifndef OBJECT3D_H
 #define OBJECT3D_H
 
+#include <vector>
 #include "ray.hpp"
 #include "hit.hpp"
 #include "material.hpp"
 #include "aabb.hpp"
 
+// Point where a ray crosses the surface of an object, see Object3D::getCrossings()
+struct Crossing {
+    float t;
+    bool entering;      // against the outward normal, into the volume the surface bounds
+
+    bool operator<(const Crossing &other) const {
+        return t < other.t;
+    }
+};
+
 // Base class for all 3d entities.
 class Object3D {
 public:
@@ -23,8 +34,37 @@ public:
     // Intersect Ray with this object. If hit, store information in hit structure.
     virtual bool intersect(const Ray &r, Hit &h, float tmin) const = 0;
 
+    // Normal, material and texture coordinates of a hit recorded by this object (see
+    // Hit::record), with r in the space of this object
+    virtual void computeSurface(const Ray &r, Hit &h) const {}
+
+    // Whether the ray hits this object at any tmin < t < tmax. Unlike intersect(), it may
+    // stop at the first hit found and computes no normals or texture coordinates, which is
+    // all visibility tests need.
+    virtual bool occluded(const Ray &r, float tmin, float tmax) const {
+        Hit h(tmax, nullptr, Vector3f::ZERO);
+        return intersect(r, h, tmin);
+    }
+
+    // Points where the line of r crosses the surface of this object, negative t included,
+    // appended to crossings in any order. The default finds them by calling intersect() once
+    // per crossing, and tells entries from exits by the world space normal of each hit.
+    virtual void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const;
+
+    // Parts of r with tmin < t < tmax inside the closed surface of this object, in order,
+    // appended to intervals. Each entry starts an interval and the next exit ends it, so a
+    // crossing reported twice (e.g. on an edge shared by two triangles) or missed only
+    // affects the one interval around it.
+    void getIntervals(const Ray &r, float tmin, float tmax, std::vector<Interval> &intervals) const;
+
     virtual AABB getAABB() const = 0;
 
+    // World-space copy of this object under the affine matrix m (with a positive determinant),
+    // or nullptr if the object cannot be baked this way.
+    virtual Object3D *transformed(const Matrix4f &m) const {
+        return nullptr;
+    }
+
     virtual float pdfValue(const Vector3f &origin, const Vector3f &direction) const {
         return 0.0f;
     }
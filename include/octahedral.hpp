@@ -0,0 +1,43 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_OCTAHEDRAL_HPP
+#define RAYTRACING_OCTAHEDRAL_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <Vector3f.h>
+
+// Unit vectors stored in 32 bits: the vector is projected onto the octahedron |x|+|y|+|z| = 1,
+// whose lower half is folded over the upper one, and the resulting square is stored as two
+// 16 bit signed normalized values. The angular error stays below 0.01 degrees.
+inline uint32_t encodeOctahedral(const Vector3f &n) {
+    float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    float x = l1 > 0 ? n[0] / l1 : 0, y = l1 > 0 ? n[1] / l1 : 0;
+    if (n[2] < 0) {
+        float fx = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+        float fy = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+        x = fx;
+        y = fy;
+    }
+    auto quantize = [](float value) {
+        return (uint32_t) (uint16_t) (int16_t) std::lround(std::fmax(-1.0f, std::fmin(1.0f, value)) * 32767.0f);
+    };
+    return quantize(x) | (quantize(y) << 16);
+}
+
+inline Vector3f decodeOctahedral(uint32_t bits) {
+    float x = (int16_t) (bits & 0xffffu) / 32767.0f;
+    float y = (int16_t) (bits >> 16) / 32767.0f;
+    float z = 1 - std::fabs(x) - std::fabs(y);
+    if (z < 0) {
+        float fx = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+        float fy = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+        x = fx;
+        y = fy;
+    }
+    return Vector3f(x, y, z).normalized();
+}
+
+#endif //RAYTRACING_OCTAHEDRAL_HPP
@@ -47,26 +47,35 @@ public:
     bool intersect(const Ray &r, Hit &h, float tmin) const override {
         float t = (d - Vector3f::dot(normal, r.getOrigin())) / Vector3f::dot(normal, r.getDirection());
         if (t > tmin && t < h.getT()) {
-            Vector3f p = r.pointAtParameter(t);
-            float u, v;
-
-            Vector3f p0 = p - normal * d;
-            u = Vector3f::dot(p0, basis1);
-            v = Vector3f::dot(p0, basis2);
-
-            // scale the uv
-            u /= uvScale;
-            v /= uvScale;
-            u -= floor(u);
-            v -= floor(v);
-
-            h.set(t, material, normal);
-            h.setUV(u, v);
+            h.record(t, this);
             return true;
         }
         return false;
     }
 
+    void computeSurface(const Ray &r, Hit &h) const override {
+        Vector3f p = r.pointAtParameter(h.getT());
+        float u, v;
+
+        Vector3f p0 = p - normal * d;
+        u = Vector3f::dot(p0, basis1);
+        v = Vector3f::dot(p0, basis2);
+
+        // scale the uv
+        u /= uvScale;
+        v /= uvScale;
+        u -= floor(u);
+        v -= floor(v);
+
+        h.setSurface(material, normal);
+        h.setUV(u, v);
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        float t = (d - Vector3f::dot(normal, r.getOrigin())) / Vector3f::dot(normal, r.getDirection());
+        return t > tmin && t < tmax;
+    }
+
     AABB getAABB() const override {
         return aabb;
     }
@@ -0,0 +1,238 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_PRIMITIVE_PACKET_HPP
+#define RAYTRACING_PRIMITIVE_PACKET_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <Vector3f.h>
+
+#include "simd_lane.hpp"
+
+// Spheres and quads as structure of arrays, tested PacketWidth at a time like
+// TrianglePacket. A sphere takes 16 bytes, a quad 56, plus a material id each, which
+// indexes a material table of whoever owns the packets. The kernels take the ray origin
+// and direction as plain floats, since Vector3f accessors are not inlined.
+
+struct SpherePacket {
+    float center[3][PacketWidth];
+    float radius[PacketWidth];
+    uint32_t material[PacketWidth];
+
+    // Unused lanes have a negative radius, which never reports a hit
+    SpherePacket() {
+        for (int lane = 0; lane < PacketWidth; lane++) {
+            center[0][lane] = center[1][lane] = center[2][lane] = 0;
+            radius[lane] = -1;
+            material[lane] = 0;
+        }
+    }
+
+    void set(int lane, const Vector3f &c, float r, uint32_t m) {
+        for (int i = 0; i < 3; i++) {
+            center[i][lane] = c[i];
+        }
+        radius[lane] = r;
+        material[lane] = m;
+    }
+
+    bool isUsed(int lane) const {
+        return radius[lane] >= 0;
+    }
+
+    Vector3f getCenter(int lane) const {
+        return Vector3f(center[0][lane], center[1][lane], center[2][lane]);
+    }
+};
+
+struct QuadPacket {
+    float corner[3][PacketWidth];
+    float a[3][PacketWidth];
+    float b[3][PacketWidth];
+    float normal[3][PacketWidth];
+    float aa[PacketWidth], bb[PacketWidth];     // squared edge lengths
+    uint32_t material[PacketWidth];
+
+    // Unused lanes have a zero normal, which is parallel to every ray
+    QuadPacket() {
+        for (int i = 0; i < 3; i++) {
+            for (int lane = 0; lane < PacketWidth; lane++) {
+                corner[i][lane] = a[i][lane] = b[i][lane] = normal[i][lane] = 0;
+            }
+        }
+        for (int lane = 0; lane < PacketWidth; lane++) {
+            aa[lane] = bb[lane] = 0;
+            material[lane] = 0;
+        }
+    }
+
+    void set(int lane, const Vector3f &c, const Vector3f &edgeA, const Vector3f &edgeB, const Vector3f &n,
+             uint32_t m) {
+        for (int i = 0; i < 3; i++) {
+            corner[i][lane] = c[i];
+            a[i][lane] = edgeA[i];
+            b[i][lane] = edgeB[i];
+            normal[i][lane] = n[i];
+        }
+        aa[lane] = edgeA.squaredLength();
+        bb[lane] = edgeB.squaredLength();
+        material[lane] = m;
+    }
+
+    bool isUsed(int lane) const {
+        return normal[0][lane] != 0 || normal[1][lane] != 0 || normal[2][lane] != 0;
+    }
+
+    Vector3f getCorner(int lane) const {
+        return Vector3f(corner[0][lane], corner[1][lane], corner[2][lane]);
+    }
+
+    Vector3f getEdgeA(int lane) const {
+        return Vector3f(a[0][lane], a[1][lane], a[2][lane]);
+    }
+
+    Vector3f getEdgeB(int lane) const {
+        return Vector3f(b[0][lane], b[1][lane], b[2][lane]);
+    }
+
+    Vector3f getNormal(int lane) const {
+        return Vector3f(normal[0][lane], normal[1][lane], normal[2][lane]);
+    }
+};
+
+// Same test as Sphere::intersect for every sphere in the packet. Returns the lane of the
+// closest hit with tmin < t < tmax, or -1. On a hit, tmax is updated.
+inline int intersectSpherePacket(const SpherePacket &p, const float *o, const float *d, float tmin, float &tmax) {
+    float dd = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+#if defined(__AVX2__) || defined(__SSE2__)
+    Lane dx = LANE_SET1(d[0]), dy = LANE_SET1(d[1]), dz = LANE_SET1(d[2]);
+    Lane ddLane = LANE_SET1(dd);
+    Lane lx = LANE_SUB(LANE_LOAD(p.center[0]), LANE_SET1(o[0]));
+    Lane ly = LANE_SUB(LANE_LOAD(p.center[1]), LANE_SET1(o[1]));
+    Lane lz = LANE_SUB(LANE_LOAD(p.center[2]), LANE_SET1(o[2]));
+    Lane radius = LANE_LOAD(p.radius);
+    Lane rr = LANE_MUL(radius, radius);
+
+    // Closest approach of the line to the center
+    Lane tp = LANE_DIV(LANE_ADD(LANE_ADD(LANE_MUL(lx, dx), LANE_MUL(ly, dy)), LANE_MUL(lz, dz)), ddLane);
+    Lane ll = LANE_ADD(LANE_ADD(LANE_MUL(lx, lx), LANE_MUL(ly, ly)), LANE_MUL(lz, lz));
+    Lane distSq = LANE_SUB(ll, LANE_MUL(LANE_MUL(tp, tp), ddLane));
+    Lane tDash = LANE_SQRT(LANE_DIV(LANE_SUB(rr, distSq), ddLane));
+    Lane t0 = LANE_SUB(tp, tDash), t1 = LANE_ADD(tp, tDash);
+
+    Lane tminLane = LANE_SET1(tmin), tmaxLane = LANE_SET1(tmax);
+    Lane nearInRange = LANE_AND(LANE_GT(t0, tminLane), LANE_LT(t0, tmaxLane));
+    Lane t = LANE_BLEND(t1, t0, nearInRange);
+
+    Lane mask = LANE_AND(LANE_LE(distSq, rr), LANE_GE(radius, LANE_SET1(0.0f)));
+    mask = LANE_AND(mask, LANE_GT(t, tminLane));
+    mask = LANE_AND(mask, LANE_LT(t, tmaxLane));
+
+    int bits = LANE_MASK(mask);
+    if (bits == 0) {
+        return -1;
+    }
+    alignas(32) float ts[PacketWidth];
+    LANE_STORE(ts, t);
+#else
+    float ts[PacketWidth];
+    int bits = 0;
+    for (int lane = 0; lane < PacketWidth; lane++) {
+        float l[3], ld = 0, ll = 0;
+        for (int i = 0; i < 3; i++) {
+            l[i] = p.center[i][lane] - o[i];
+            ld += l[i] * d[i];
+            ll += l[i] * l[i];
+        }
+        float rr = p.radius[lane] * p.radius[lane];
+        float tp = ld / dd;
+        float distSq = ll - tp * tp * dd;
+        if (p.radius[lane] < 0 || distSq > rr) continue;
+
+        float tDash = std::sqrt((rr - distSq) / dd);
+        ts[lane] = tp - tDash;
+        if (ts[lane] <= tmin || ts[lane] >= tmax) {
+            ts[lane] = tp + tDash;
+        }
+        if (ts[lane] > tmin && ts[lane] < tmax) {
+            bits |= 1 << lane;
+        }
+    }
+    if (bits == 0) {
+        return -1;
+    }
+#endif
+    return closestLane(bits, ts, tmax);
+}
+
+// Same test as Quad::intersect for every quad in the packet. Returns the lane of the
+// closest hit with tmin <= t < tmax, or -1. On a hit, tmax is updated.
+inline int intersectQuadPacket(const QuadPacket &p, const float *o, const float *d, float tmin, float &tmax) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    Lane dx = LANE_SET1(d[0]), dy = LANE_SET1(d[1]), dz = LANE_SET1(d[2]);
+    Lane nx = LANE_LOAD(p.normal[0]), ny = LANE_LOAD(p.normal[1]), nz = LANE_LOAD(p.normal[2]);
+    Lane sx = LANE_SUB(LANE_LOAD(p.corner[0]), LANE_SET1(o[0]));
+    Lane sy = LANE_SUB(LANE_LOAD(p.corner[1]), LANE_SET1(o[1]));
+    Lane sz = LANE_SUB(LANE_LOAD(p.corner[2]), LANE_SET1(o[2]));
+
+    Lane denominator = LANE_ADD(LANE_ADD(LANE_MUL(nx, dx), LANE_MUL(ny, dy)), LANE_MUL(nz, dz));
+    Lane t = LANE_DIV(LANE_ADD(LANE_ADD(LANE_MUL(sx, nx), LANE_MUL(sy, ny)), LANE_MUL(sz, nz)), denominator);
+
+    // Offset of the hit point from the corner, o + t * d - corner
+    Lane px = LANE_SUB(LANE_MUL(t, dx), sx);
+    Lane py = LANE_SUB(LANE_MUL(t, dy), sy);
+    Lane pz = LANE_SUB(LANE_MUL(t, dz), sz);
+    Lane pa = LANE_ADD(LANE_ADD(LANE_MUL(px, LANE_LOAD(p.a[0])), LANE_MUL(py, LANE_LOAD(p.a[1]))),
+                       LANE_MUL(pz, LANE_LOAD(p.a[2])));
+    Lane pb = LANE_ADD(LANE_ADD(LANE_MUL(px, LANE_LOAD(p.b[0])), LANE_MUL(py, LANE_LOAD(p.b[1]))),
+                       LANE_MUL(pz, LANE_LOAD(p.b[2])));
+
+    Lane zero = LANE_SET1(0.0f);
+    Lane mask = LANE_OR(LANE_GT(denominator, LANE_SET1(1e-6f)), LANE_LT(denominator, LANE_SET1(-1e-6f)));
+    mask = LANE_AND(mask, LANE_GE(t, LANE_SET1(tmin)));
+    mask = LANE_AND(mask, LANE_LT(t, LANE_SET1(tmax)));
+    mask = LANE_AND(mask, LANE_GE(pa, zero));
+    mask = LANE_AND(mask, LANE_LE(pa, LANE_LOAD(p.aa)));
+    mask = LANE_AND(mask, LANE_GE(pb, zero));
+    mask = LANE_AND(mask, LANE_LE(pb, LANE_LOAD(p.bb)));
+
+    int bits = LANE_MASK(mask);
+    if (bits == 0) {
+        return -1;
+    }
+    alignas(32) float ts[PacketWidth];
+    LANE_STORE(ts, t);
+#else
+    float ts[PacketWidth];
+    int bits = 0;
+    for (int lane = 0; lane < PacketWidth; lane++) {
+        float denominator = 0, sn = 0;
+        for (int i = 0; i < 3; i++) {
+            denominator += p.normal[i][lane] * d[i];
+            sn += (p.corner[i][lane] - o[i]) * p.normal[i][lane];
+        }
+        if (std::fabs(denominator) < 1e-6f) continue;
+
+        ts[lane] = sn / denominator;
+        if (ts[lane] < tmin || ts[lane] >= tmax) continue;
+
+        float pa = 0, pb = 0;
+        for (int i = 0; i < 3; i++) {
+            float offset = o[i] + ts[lane] * d[i] - p.corner[i][lane];
+            pa += offset * p.a[i][lane];
+            pb += offset * p.b[i][lane];
+        }
+        if (pa >= 0 && pa <= p.aa[lane] && pb >= 0 && pb <= p.bb[lane]) {
+            bits |= 1 << lane;
+        }
+    }
+    if (bits == 0) {
+        return -1;
+    }
+#endif
+    return closestLane(bits, ts, tmax);
+}
+
+#endif //RAYTRACING_PRIMITIVE_PACKET_HPP
@@ -0,0 +1,89 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_PRIMITIVE_POOL_HPP
+#define RAYTRACING_PRIMITIVE_POOL_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "primitive_packet.hpp"
+#include "sphere.hpp"
+#include "quad.hpp"
+
+// Spheres and quads without an Object3D of their own, packed in the order they were added
+// into SpherePackets and QuadPackets, with an index into a table of materials per lane.
+// A sphere takes 20 bytes and a quad 60, instead of a heap object with a uv rotation and a
+// bounding box. A FlatBVH is built over them through temporary objects (see
+// instantiate()), and copies them into the packets of its leaves.
+class PrimitivePool {
+public:
+    void addSphere(const Vector3f &center, float radius, Material *material) {
+        if (sphereCount % PacketWidth == 0) {
+            spheres.emplace_back();
+        }
+        spheres.back().set(sphereCount++ % PacketWidth, center, radius, getMaterialId(material));
+    }
+
+    // Same parameters as the Quad constructor
+    void addQuad(const Vector3f &center, const Vector3f &a, const Vector3f &b, Material *material) {
+        if (quadCount % PacketWidth == 0) {
+            quads.emplace_back();
+        }
+        quads.back().set(quadCount++ % PacketWidth, center - a / 2 - b / 2, a, b,
+                         Vector3f::cross(a, b).normalized(), getMaterialId(material));
+    }
+
+    int getSphereCount() const {
+        return sphereCount;
+    }
+
+    int getQuadCount() const {
+        return quadCount;
+    }
+
+    bool empty() const {
+        return sphereCount == 0 && quadCount == 0;
+    }
+
+    size_t getMemoryUsage() const {
+        return spheres.size() * sizeof(SpherePacket) + quads.size() * sizeof(QuadPacket)
+               + materials.size() * (sizeof(Material*) + sizeof(std::pair<Material*, uint32_t>));
+    }
+
+    // Appends an object for every pooled primitive to sphereObjects and quadObjects, which
+    // must not grow while a structure built over the objects is in use
+    void instantiate(std::vector<Sphere> &sphereObjects, std::vector<Quad> &quadObjects) const {
+        sphereObjects.reserve(sphereObjects.size() + sphereCount);
+        for (int i = 0; i < sphereCount; i++) {
+            const SpherePacket &packet = spheres[i / PacketWidth];
+            int lane = i % PacketWidth;
+            sphereObjects.emplace_back(packet.getCenter(lane), packet.radius[lane], materials[packet.material[lane]]);
+        }
+        quadObjects.reserve(quadObjects.size() + quadCount);
+        for (int i = 0; i < quadCount; i++) {
+            const QuadPacket &packet = quads[i / PacketWidth];
+            int lane = i % PacketWidth;
+            quadObjects.push_back(Quad::fromCorner(packet.getCorner(lane), packet.getEdgeA(lane), packet.getEdgeB(lane),
+                                                   materials[packet.material[lane]]));
+        }
+    }
+
+private:
+    std::vector<SpherePacket> spheres;
+    std::vector<QuadPacket> quads;
+    int sphereCount = 0, quadCount = 0;
+    std::vector<Material*> materials;
+    std::unordered_map<Material*, uint32_t> materialIds;
+
+    uint32_t getMaterialId(Material *material) {
+        auto inserted = materialIds.emplace(material, (uint32_t) materials.size());
+        if (inserted.second) {
+            materials.push_back(material);
+        }
+        return inserted.first->second;
+    }
+};
+
+#endif //RAYTRACING_PRIMITIVE_POOL_HPP
@@ -14,27 +14,43 @@ public:
         normal = Vector3f::cross(a, b).normalized();
         upperLeft = center - a / 2 - b / 2;
 
-        Vector3f bottomRight = upperLeft + a + b;
-        aabb = AABB(upperLeft, bottomRight);
+        // All four corners, the diagonal alone misses the others when a and b are not axis aligned
+        aabb = AABB(upperLeft, upperLeft + a + b);
+        aabb.expand(upperLeft + a);
+        aabb.expand(upperLeft + b);
     }
 
     ~Quad() override = default;
 
+    // The quad spanned by a and b from corner, which the constructor computes from the center
+    static Quad fromCorner(const Vector3f &corner, const Vector3f &a, const Vector3f &b, Material *m) {
+        Quad quad(corner + a / 2 + b / 2, a, b, m);
+        quad.upperLeft = corner;
+        quad.aabb = AABB(corner, corner + a + b);
+        quad.aabb.expand(corner + a);
+        quad.aabb.expand(corner + b);
+        return quad;
+    }
+
     bool intersect(const Ray &r, Hit &h, float tmin) const override {
-        auto denominator = Vector3f::dot(normal, r.getDirection());
-        if (fabs(denominator) < 1e-6) return false;
+        float t;
+        if (!solve(r, t) || t < tmin || t > h.getT()) return false;
 
-        auto t = Vector3f::dot(upperLeft - r.getOrigin(), normal) / denominator;
-        if (t < tmin || t > h.getT()) return false;
+        h.record(t, this);
+        return true;
+    }
 
-        auto p = r.pointAtParameter(t);
-        auto d = p - upperLeft;
-        auto ddota = Vector3f::dot(d, a);
-        auto ddotb = Vector3f::dot(d, b);
-        if (ddota < 0 || ddota > a.squaredLength() || ddotb < 0 || ddotb > b.squaredLength()) return false;
+    // Boxes made of quads (e.g. in a Group) report one crossing per face. Their normals,
+    // cross(a, b), have to point out of the box.
+    void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const override {
+        float t;
+        if (solve(r, t)) {
+            crossings.push_back({t, Vector3f::dot(normal, r.getDirection()) < 0});
+        }
+    }
 
-        h.set(t, material, normal);
-        return true;
+    void computeSurface(const Ray &r, Hit &h) const override {
+        h.setSurface(material, normal);
     }
 
     float pdfValue(const Vector3f &o, const Vector3f &v) const override {
@@ -42,7 +58,7 @@ public:
         if (intersect(Ray(o, v), h, 0.001f)) {
             float area = Vector3f::cross(a, b).length();
             float distance_squared = h.getT() * h.getT() * v.squaredLength();
-            float cosine = fabs(Vector3f::dot(v.normalized(), h.getNormal()));
+            float cosine = fabs(Vector3f::dot(v.normalized(), normal));
             return distance_squared / (cosine * area);
         } else {
             return 0;
@@ -57,9 +73,46 @@ public:
     AABB getAABB() const override {
         return aabb;
     }
+
+    // Corner the edges a and b start from
+    const Vector3f &getCorner() const {
+        return upperLeft;
+    }
+
+    const Vector3f &getEdgeA() const {
+        return a;
+    }
+
+    const Vector3f &getEdgeB() const {
+        return b;
+    }
+
+    const Vector3f &getNormal() const {
+        return normal;
+    }
+
+    // Affine maps keep parallelograms parallelograms
+    Object3D *transformed(const Matrix4f &m) const override {
+        Matrix3f linear = m.getSubmatrix3x3(0, 0);
+        Vector3f center = upperLeft + a / 2 + b / 2;
+        return new Quad((m * Vector4f(center, 1)).xyz(), linear * a, linear * b, material);
+    }
 private:
     Vector3f upperLeft, a, b, normal;
     AABB aabb;
+
+    // Parameter t where the line of r crosses the quad, if it does
+    bool solve(const Ray &r, float &t) const {
+        auto denominator = Vector3f::dot(normal, r.getDirection());
+        if (fabs(denominator) < 1e-6) return false;
+
+        t = Vector3f::dot(upperLeft - r.getOrigin(), normal) / denominator;
+        auto p = r.pointAtParameter(t);
+        auto d = p - upperLeft;
+        auto ddota = Vector3f::dot(d, a);
+        auto ddotb = Vector3f::dot(d, b);
+        return ddota >= 0 && ddota <= a.squaredLength() && ddotb >= 0 && ddotb <= b.squaredLength();
+    }
 };
 
 #endif //RAYTRACING_QUAD_HPP
@@ -17,12 +17,13 @@ public:
     Ray(const Vector3f &orig, const Vector3f &dir) {
         origin = orig;
         direction = dir;
+        for (int i = 0; i < 3; i++) {
+            invDirection[i] = 1.0f / dir[i];
+            sign[i] = invDirection[i] < 0;
+        }
     }
 
-    Ray(const Ray &r) {
-        origin = r.origin;
-        direction = r.direction;
-    }
+    Ray(const Ray &r) = default;
 
     const Vector3f &getOrigin() const {
         return origin;
@@ -32,6 +33,17 @@ public:
         return direction;
     }
 
+    // Reciprocal of each direction component, +-inf for 0, for slab tests against boxes.
+    // Plain floats, since the Vector3f accessors are not inlined.
+    const float *getInvDirection() const {
+        return invDirection;
+    }
+
+    // 1 if the direction component is negative, so that the far plane of a box comes first
+    int getSign(int axis) const {
+        return sign[axis];
+    }
+
     Vector3f pointAtParameter(float t) const {
         return origin + direction * t;
     }
@@ -40,6 +52,8 @@ private:
 
     Vector3f origin;
     Vector3f direction;
+    float invDirection[3];
+    int sign[3];
 
 };
 
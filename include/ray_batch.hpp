@@ -0,0 +1,110 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_RAY_BATCH_HPP
+#define RAYTRACING_RAY_BATCH_HPP
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "hit.hpp"
+#include "ray.hpp"
+
+// Rays for Scene::intersect(const RayBatch &, HitBatch &) and Scene::occluded(), e.g. the
+// visibility or collision queries of a frame. All rays share tmin, each has its own tmax.
+class RayBatch {
+public:
+    explicit RayBatch(float tmin = 1e-4f) : tmin(tmin) {}
+
+    void add(const Ray &r, float tmax = MAXFLOAT) {
+        rays.push_back(r);
+        tmaxs.push_back(tmax);
+    }
+
+    void reserve(int count) {
+        rays.reserve(count);
+        tmaxs.reserve(count);
+    }
+
+    void clear() {
+        rays.clear();
+        tmaxs.clear();
+    }
+
+    int size() const {
+        return (int) rays.size();
+    }
+
+    const Ray &getRay(int i) const {
+        return rays[i];
+    }
+
+    const Ray *getRays() const {
+        return rays.data();
+    }
+
+    float getTMin() const {
+        return tmin;
+    }
+
+    float getTMax(int i) const {
+        return tmaxs[i];
+    }
+
+    const float *getTMaxs() const {
+        return tmaxs.data();
+    }
+
+private:
+    std::vector<Ray> rays;
+    std::vector<float> tmaxs;
+    float tmin;
+};
+
+// Results of a RayBatch, one per ray. After Scene::intersect(), hits carry their surface
+// (normal, material and texture coordinates); Scene::occluded() only sets isHit().
+class HitBatch {
+public:
+    // Makes room for count results, all misses
+    void resize(int count) {
+        hits.assign(count, Hit());
+        results.reset(new bool[count]());
+        size = count;
+    }
+
+    int getSize() const {
+        return size;
+    }
+
+    bool isHit(int i) const {
+        return results[i];
+    }
+
+    const Hit &getHit(int i) const {
+        return hits[i];
+    }
+
+    int getHitCount() const {
+        int count = 0;
+        for (int i = 0; i < size; i++) {
+            count += results[i];
+        }
+        return count;
+    }
+
+    Hit *getHits() {
+        return hits.data();
+    }
+
+    bool *getResults() {
+        return results.get();
+    }
+
+private:
+    std::vector<Hit> hits;
+    std::unique_ptr<bool[]> results;
+    int size = 0;
+};
+
+#endif //RAYTRACING_RAY_BATCH_HPP
@@ -0,0 +1,78 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_RAY_SORTER_HPP
+#define RAYTRACING_RAY_SORTER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "aabb.hpp"
+#include "ray.hpp"
+
+// Spreads the low 10 bits of v so that two zero bits follow each of them
+inline uint32_t spreadBits3(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Spreads the low 4 bits of v so that a zero bit follows each of them
+inline uint32_t spreadBits2(uint32_t v) {
+    v &= 0xf;
+    v = (v | (v << 2)) & 0x33;
+    v = (v | (v << 1)) & 0x55;
+    return v;
+}
+
+// Sort key that bins a ray by the octant of its direction (top 3 bits), then by the cell of
+// its origin on a 1024^3 grid over bounds along a Morton curve (30 bits), then by its
+// direction within the octant on a 16x16 grid (8 bits). Rays with close keys start close to
+// each other and point roughly the same way, so they visit mostly the same nodes.
+inline uint64_t getRayKey(const Ray &r, const AABB &bounds) {
+    const float *o = &r.getOrigin()[0];
+    const float *d = &r.getDirection()[0];
+    uint32_t octant = 0, cell[3];
+    for (int axis = 0; axis < 3; axis++) {
+        octant |= (uint32_t) r.getSign(axis) << axis;
+        Interval interval = bounds.getAxis(axis);
+        float length = interval.getLength();
+        float relative = length > 0 ? (o[axis] - interval.getMin()) / length : 0;
+        cell[axis] = (uint32_t) std::max(0.0f, std::min(1023.0f, relative * 1024));
+    }
+    uint32_t origin = spreadBits3(cell[0]) | (spreadBits3(cell[1]) << 1) | (spreadBits3(cell[2]) << 2);
+
+    float l1 = std::fabs(d[0]) + std::fabs(d[1]) + std::fabs(d[2]);
+    uint32_t u = l1 > 0 ? (uint32_t) std::min(15.0f, std::fabs(d[0]) / l1 * 16) : 0;
+    uint32_t v = l1 > 0 ? (uint32_t) std::min(15.0f, std::fabs(d[1]) / l1 * 16) : 0;
+    uint32_t direction = spreadBits2(u) | (spreadBits2(v) << 1);
+
+    return ((uint64_t) octant << 38) | ((uint64_t) origin << 8) | direction;
+}
+
+// Indices of the count rays in the order of getRayKey() over the bounds of their origins
+inline void sortRays(const Ray *rays, int count, std::vector<int> &order) {
+    AABB bounds;
+    for (int i = 0; i < count; i++) {
+        bounds.expand(rays[i].getOrigin());
+    }
+
+    std::vector<std::pair<uint64_t, int>> keys(count);
+    for (int i = 0; i < count; i++) {
+        keys[i] = std::make_pair(getRayKey(rays[i], bounds), i);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    order.resize(count);
+    for (int i = 0; i < count; i++) {
+        order[i] = keys[i].second;
+    }
+}
+
+#endif //RAYTRACING_RAY_SORTER_HPP
@@ -0,0 +1,46 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_RENDERER_HPP
+#define RAYTRACING_RENDERER_HPP
+
+#include <string>
+#include <vecmath.h>
+
+class Image;
+class Object3D;
+class Ray;
+class Scene;
+
+// Progressive path tracer over a built Scene. Every round traces some samples per pixel
+// and blends them into the image, doubling the samples from round to round.
+class Renderer {
+public:
+    enum Mode {
+        RecursiveMode,      // one task per pixel, following each path on its own
+        WavefrontMode,      // one column per thread at a time, traced bounce by bounce
+        SortedMode          // as WavefrontMode, sorting the scattered rays of every bounce
+    };
+
+    Renderer(Scene *scene, int threads, Mode mode = RecursiveMode);
+
+    // Renders rounds from 16 samples per pixel up to sampleLimit, saving the image after
+    // every round to outputFile with the sample count appended, and finally to outputFile
+    void render(const std::string &outputFile, int sampleLimit = 1000);
+
+    // Radiance arriving along ray, following a single path
+    static Vector3f trace(const Ray &ray, Scene *scene, Object3D *lights, int depth);
+
+private:
+    Scene *scene;
+    int threads;
+    Mode mode;
+
+    Vector3f tracePixel(int i, int j, int samples) const;
+
+    // Traces all samples of column i as one batch of paths and stores the pixels
+    void traceColumnWavefront(int i, int samples, Image &image) const;
+};
+
+#endif //RAYTRACING_RENDERER_HPP
@@ -13,17 +13,31 @@ class Light;
 class Material;
 class Object3D;
 class Group;
-class BVHNode;
+class Accelerator;
+class PrimitivePool;
+class RayBatch;
+class HitBatch;
 
 class Scene {
 public:
 
+    enum AcceleratorType {
+        BVHAccelerator,     // see setDynamic(), setLazyBuild(), setCompressed() and setFlat()
+        GridAccelerator,    // UniformGrid
+        KdTreeAccelerator   // KdTree
+    };
+
     Scene();
 
     ~Scene();
 
     void buildScene();
 
+    // Refit the BVH after objects moved (e.g. Transform::setMatrix between frames),
+    // rebuilding only the subtrees whose SAH cost degraded past the rebuild threshold.
+    // Returns the number of rebuilt subtrees.
+    int updateScene();
+
     /* Getters */
 
     Camera *getCamera() const {
@@ -42,10 +56,21 @@ public:
         return group;
     }
 
-    BVHNode *getBVHRoot() const {
-        return bvh_root;
+    // The structure rays should be traced against, nullptr before buildScene()
+    Accelerator *getAccelerator() const {
+        return accelerator;
     }
 
+    /* Batched queries, after buildScene(). Before, they return false with every ray a miss. */
+
+    // Closest hit of every ray in the batch, with its surface computed. The rays are split
+    // between threads (all hardware threads for 0), and a flat BVH interleaves the rays of
+    // each thread to overlap their cache misses.
+    bool intersect(const RayBatch &rays, HitBatch &hits, int threads = 0) const;
+
+    // Whether every ray in the batch hits anything at tmin < t < tmax, split like intersect()
+    bool occluded(const RayBatch &rays, HitBatch &hits, int threads = 0) const;
+
     /* Setters */
 
     void setCamera(Camera *cam) {
@@ -56,15 +81,97 @@ public:
         background_color = color;
     }
 
+    // Relative SAH cost growth that triggers a rebuild in updateScene()
+    void setRebuildThreshold(float threshold) {
+        rebuild_threshold = threshold;
+    }
+
+    // Build an incrementally updatable BVH, so that objects can be added and removed
+    // after buildScene() without rebuilding the whole hierarchy
+    void setDynamic(bool isDynamic) {
+        dynamic = isDynamic;
+    }
+
+    // Split BVH nodes on demand while rendering instead of building the whole
+    // hierarchy in buildScene(), so that the first pixels appear sooner
+    void setLazyBuild(bool isLazy) {
+        lazy = isLazy;
+    }
+
+    // Structure buildScene() builds over the objects. The BVH options below only apply to
+    // BVHAccelerator; grids and kd-trees are rebuilt from scratch by updateScene().
+    void setAcceleratorType(AcceleratorType type) {
+        accelerator_type = type;
+    }
+
+    // Trace against a flattened BVH with 8 bit quantized child bounds to save memory
+    void setCompressed(bool isCompressed) {
+        compressed = isCompressed;
+    }
+
+    // Trace against a flattened BVH whose leaves test spheres and quads in SIMD packets
+    // and triangles and Bezier patches from per-type arrays, without virtual calls
+    void setFlat(bool isFlat) {
+        flat = isFlat;
+    }
+
+    // Flatten Transforms into world-space geometry in buildScene(). Baked transforms
+    // are deleted, so only enable this for transforms that never move afterwards.
+    // Instances keep sharing their geometry either way.
+    void setBakeTransforms(bool bake) {
+        bake_transforms = bake;
+    }
+
+    // Largest surface error, in pixels, that level of detail selection may introduce
+    void setLODThreshold(float pixels) {
+        lod_threshold = pixels;
+    }
+
+    // Let every Instance of a Mesh with levels of detail trace the coarsest level whose
+    // error projects to at most the LOD threshold under the PerspectiveCamera, blended with
+    // the next finer level. Called by buildScene() and updateScene(); call it again after
+    // moving the camera.
+    void selectLODs();
+
     void addObject(Object3D *object);
 
+    void removeObject(Object3D *object);
+
+    // Add a sphere or quad without an object of its own, packed into the primitive pool, if
+    // the scene is traced through the flat BVH (setFlat()). Otherwise, and for emissive
+    // materials, which lights have to sample, these create a Sphere or Quad object.
+    // Pooled primitives cannot be removed again.
+    void addSphere(const Vector3f &center, float radius, Material *material);
+
+    void addQuad(const Vector3f &center, const Vector3f &a, const Vector3f &b, Material *material);
+
 private:
 
+    // Whether rebuild() builds the flat BVH, the only structure that traces pooled primitives
+    bool tracesFlatBVH() const;
+
+    // Replace the pooled primitives by objects, before building another structure
+    void unpool();
+
+    void bakeTransforms();
+
+    // (Re)build the grid, kd-tree or static, lazy, compressed or flat BVH over all objects
+    void rebuild(bool report = false);
+
     Camera *camera;
     Vector3f background_color;
     Group *lights;
     Group *group;
-    BVHNode *bvh_root;
+    Accelerator *accelerator;      // BVH of any kind, grid or kd-tree
+    PrimitivePool *pool;
+    AcceleratorType accelerator_type;
+    bool dynamic;
+    bool lazy;
+    bool compressed;
+    bool flat;
+    bool bake_transforms;
+    float rebuild_threshold;
+    float lod_threshold;
 };
 
 #endif // SCENE_PARSER_H
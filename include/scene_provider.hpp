@@ -15,10 +15,11 @@
 #include "image.hpp"
 #include "mesh.hpp"
 #include "transform.hpp"
+#include "instance.hpp"
 #include "surface.hpp"
 #include "curve.hpp"
 
-void setScene01(Scene &scene) {
+inline void setScene01(Scene &scene) {
     scene.setCamera(new PerspectiveCamera(Vector3f(0, 0, 10),
                                           Vector3f(0, 0, -1),
                                           Vector3f(0, 1, 0)));
@@ -74,7 +75,7 @@ void setScene01(Scene &scene) {
     scene.addObject(new Sphere(Vector3f(0, -2, 2), 0.5, glassMaterial));
 }
 
-void setScene02(Scene &scene) {
+inline void setScene02(Scene &scene) {
     scene.setCamera(new PerspectiveCamera(Vector3f(5, 5, 10),
                                           Vector3f(-0.5, -0.5, -1),
                                           Vector3f(0, 1, 0),
@@ -109,7 +110,7 @@ void setScene02(Scene &scene) {
                                   6 * Vector3f(1, 1, 1), Vector3f(-0.5, -1, 0), 0, 0, 0));
 }
 
-void setScene03(Scene &scene) {
+inline void setScene03(Scene &scene) {
     scene.setCamera(new PerspectiveCamera(Vector3f(0, 0, 10),
                                           Vector3f(0, 0, -1),
                                           Vector3f(0, 1, 0),
@@ -158,4 +159,33 @@ void setScene03(Scene &scene) {
 //                                  Vector3f(-0.5, -1.4, -0.5), 90, 0, 0));
 }
 
+inline void setScene04(Scene &scene) {
+    scene.setCamera(new PerspectiveCamera(Vector3f(0, 6, 14),
+                                          Vector3f(0, -0.5, -1),
+                                          Vector3f(0, 1, 0)));
+
+    auto white = new ConstantTexture(Vector3f(1, 1, 1));
+    auto gray = new ConstantTexture(0.5 * Vector3f(1, 1, 1));
+    auto orange = new ConstantTexture(Vector3f(1, 0.5, 0.2));
+
+    auto groundMaterial = new PrincipledSpecularMaterial(0, 0, 0, 0, 0, 0,
+                                                         gray, white, white, nullptr);
+    auto bunnyMaterial = new PrincipledSpecularMaterial(0.2, 0, 0, 0.3, 0, 0,
+                                                        orange, white, white, nullptr);
+    auto emissiveMaterial = new PrincipledSpecularMaterial(0, 0, 1, 0, 0, 4,
+                                                           white, white, white, nullptr);
+    scene.addObject(new Plane(Vector3f(0, 1, 0), -1, groundMaterial)); // Ground
+    scene.addObject(new Quad(Vector3f(0, 8, 0), Vector3f(8, 0, 0), Vector3f(0, 0, 8), emissiveMaterial));
+
+    // A single bunny shared by all instances
+    auto bunny = new Mesh("mesh/bunny_200.obj", bunnyMaterial);
+    bunny->buildLODs(3);
+    for (int i = -5; i < 5; i++) {
+        for (int j = -5; j < 5; j++) {
+            scene.addObject(new Instance(bunny, 3 * Vector3f(1, 1, 1), Vector3f(1.6f * i, -1.1, 1.6f * j),
+                                         0, 36.0f * (i + j), 0));
+        }
+    }
+}
+
 #endif //RAYTRACING_SCENE_PROVIDER_HPP
@@ -0,0 +1,75 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_SIMD_LANE_HPP
+#define RAYTRACING_SIMD_LANE_HPP
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Lane type and operations shared by the packet kernels (see triangle_packet.hpp and
+// primitive_packet.hpp): 8 floats with AVX2, 4 with SSE2. Without either, the kernels
+// loop over PacketWidth lanes in plain C++.
+#if defined(__AVX2__)
+const int PacketWidth = 8;
+
+typedef __m256 Lane;
+#define LANE_SET1 _mm256_set1_ps
+#define LANE_LOAD _mm256_loadu_ps
+#define LANE_ADD _mm256_add_ps
+#define LANE_SUB _mm256_sub_ps
+#define LANE_MUL _mm256_mul_ps
+#define LANE_DIV _mm256_div_ps
+#define LANE_SQRT _mm256_sqrt_ps
+#define LANE_AND _mm256_and_ps
+#define LANE_OR _mm256_or_ps
+#define LANE_BLEND _mm256_blendv_ps
+#define LANE_GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define LANE_GE(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define LANE_LT(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define LANE_LE(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define LANE_NE(a, b) _mm256_cmp_ps(a, b, _CMP_NEQ_OQ)
+#define LANE_MASK _mm256_movemask_ps
+#define LANE_STORE _mm256_store_ps
+#elif defined(__SSE2__)
+const int PacketWidth = 4;
+
+typedef __m128 Lane;
+#define LANE_SET1 _mm_set1_ps
+#define LANE_LOAD _mm_loadu_ps
+#define LANE_ADD _mm_add_ps
+#define LANE_SUB _mm_sub_ps
+#define LANE_MUL _mm_mul_ps
+#define LANE_DIV _mm_div_ps
+#define LANE_SQRT _mm_sqrt_ps
+#define LANE_AND _mm_and_ps
+#define LANE_OR _mm_or_ps
+// (mask & b) | (~mask & a), as SSE2 has no blend
+#define LANE_BLEND(a, b, mask) _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a))
+#define LANE_GT _mm_cmpgt_ps
+#define LANE_GE _mm_cmpge_ps
+#define LANE_LT _mm_cmplt_ps
+#define LANE_LE _mm_cmple_ps
+#define LANE_NE _mm_cmpneq_ps
+#define LANE_MASK _mm_movemask_ps
+#define LANE_STORE _mm_store_ps
+#else
+const int PacketWidth = 4;
+#endif
+
+// Lane of the smallest t among the lanes set in bits, or -1 if none is closer than tmax.
+// tmax is updated to that t.
+inline int closestLane(int bits, const float *ts, float &tmax) {
+    int best = -1;
+    for (int lane = 0; lane < PacketWidth; lane++) {
+        if ((bits & (1 << lane)) && ts[lane] < tmax) {
+            tmax = ts[lane];
+            best = lane;
+        }
+    }
+    return best;
+}
+
+#endif //RAYTRACING_SIMD_LANE_HPP
@@ -32,37 +32,42 @@ public:
     ~Sphere() override = default;
 
     bool intersect(const Ray &r, Hit &h, float tmin) const override {
-        Ray rayNormalized(r.getOrigin(), r.getDirection().normalized());
-
-        Vector3f l = center - rayNormalized.getOrigin();
-        float l_sq = l.squaredLength();
-        float r_sq = radius * radius;
-
-        float tp = Vector3f::dot(l, rayNormalized.getDirection());
-        if (tp < 0 && l_sq < r_sq) return false;
-        
-        float d_sq = l_sq - tp * tp;
-        if (d_sq > r_sq) return false;
-
-        float t_dash = sqrt(r_sq - d_sq);
-
-        float t = tp - t_dash;
+        float t0, t1;
+        if (!solve(r, t0, t1)) return false;
 
+        float t = t0;
         if (t <= tmin || t >= h.getT()) {
-            t = tp + t_dash;
+            t = t1;
             if (t <= tmin || t >= h.getT()) {
                 return false;
             }
         }
 
-        Vector3f outwardNormal = (rayNormalized.pointAtParameter(t) - center).normalized();
-        h.set(t, material, outwardNormal);
+        h.record(t, this);
+        return true;
+    }
+
+    void computeSurface(const Ray &r, Hit &h) const override {
+        Vector3f outwardNormal = (r.pointAtParameter(h.getT()) - center).normalized();
+        h.setSurface(material, outwardNormal);
 
         float u, v;
         getSphereUV(outwardNormal, u, v);
         h.setUV(u, v);
+    }
 
-        return true;
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        float t0, t1;
+        if (!solve(r, t0, t1)) return false;
+        return (t0 > tmin && t0 < tmax) || (t1 > tmin && t1 < tmax);
+    }
+
+    void getCrossings(const Ray &r, std::vector<Crossing> &crossings) const override {
+        float t0, t1;
+        if (solve(r, t0, t1)) {
+            crossings.push_back({t0, true});
+            crossings.push_back({t1, false});
+        }
     }
 
     Vector3f random(const Vector3f &origin) const override {
@@ -74,8 +79,7 @@ public:
     }
 
     float pdfValue(const Vector3f &origin, const Vector3f &direction) const override {
-        Hit h;
-        if (!intersect(Ray(origin, direction), h, 0.001f)) {
+        if (!occluded(Ray(origin, direction), 0.001f, MAXFLOAT)) {
             return 0;
         }
 
@@ -88,21 +92,82 @@ public:
         return aabb;
     }
 
+    const Vector3f &getCenter() const {
+        return center;
+    }
+
+    float getRadius() const {
+        return radius;
+    }
+
+    // Whether texture coordinates are rotated, by uvRotation or the uv axes
+    bool hasUVRotation() const {
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                if (rotation(i, j) != (i == j ? 1.0f : 0.0f)) return true;
+            }
+        }
+        return false;
+    }
+
+    // Texture coordinates of a point p on the unit sphere, without any rotation
+    static void getUnitSphereUV(const Vector3f &p, float &u, float &v) {
+        float phi = atan2(p.z(), p.x());
+        float theta = asin(p.y());
+        u = 1 - (phi + M_PI) / (2 * M_PI);
+        v = (theta + M_PI / 2) / M_PI;
+    }
+
+    // Only similarity transforms keep a sphere a sphere
+    Object3D *transformed(const Matrix4f &m) const override {
+        Matrix3f linear = m.getSubmatrix3x3(0, 0);
+        Vector3f columns[3] = {linear.getCol(0), linear.getCol(1), linear.getCol(2)};
+        float scale = columns[0].length();
+        for (int i = 0; i < 3; i++) {
+            if (fabs(columns[i].length() - scale) > 1e-4f * scale) return nullptr;
+            if (fabs(Vector3f::dot(columns[i], columns[(i + 1) % 3])) > 1e-4f * scale * scale) return nullptr;
+        }
+
+        // Texture lookups use the normal in object space, i.e. rotated back by the transpose
+        auto sphere = new Sphere(*this);
+        sphere->center = (m * Vector4f(center, 1)).xyz();
+        sphere->radius = radius * scale;
+        Matrix3f objectRotation(columns[0] / scale, columns[1] / scale, columns[2] / scale);
+        sphere->rotation = rotation * objectRotation.transposed();
+        Vector3f r = Vector3f(sphere->radius, sphere->radius, sphere->radius);
+        sphere->aabb = AABB(sphere->center - r, sphere->center + r);
+        return sphere;
+    }
+
 protected:
     Vector3f center;
     float radius;
     Matrix3f rotation;
     AABB aabb;
 
+    // Ray parameters t0 <= t1 where the ray line enters and leaves the sphere. The direction
+    // is used as it is, so t matches the other primitives also for scaled (instanced) rays.
+    bool solve(const Ray &r, float &t0, float &t1) const {
+        Vector3f l = center - r.getOrigin();
+        const Vector3f &d = r.getDirection();
+        float d_dot = d.squaredLength();
+        float r_sq = radius * radius;
+
+        // Closest approach of the line to the center
+        float tp = Vector3f::dot(l, d) / d_dot;
+        float dist_sq = l.squaredLength() - tp * tp * d_dot;
+        if (dist_sq > r_sq) return false;
+
+        float t_dash = sqrt((r_sq - dist_sq) / d_dot);
+        t0 = tp - t_dash;
+        t1 = tp + t_dash;
+        return true;
+    }
+
     void getSphereUV(const Vector3f &p, float &u, float &v) const {
         // p is a point on the unit sphere
         // u,v is the texture coordinate
-        Vector3f rotatedP = rotation * p;
-
-        float phi = atan2(rotatedP.z(), rotatedP.x());
-        float theta = asin(rotatedP.y());
-        u = 1 - (phi + M_PI) / (2 * M_PI);
-        v = (theta + M_PI / 2) / M_PI;
+        getUnitSphereUV(rotation * p, u, v);
     }
 };
 
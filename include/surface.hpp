@@ -30,6 +30,17 @@ public:
         return aabb;
     }
 
+    // Bezier surfaces are affine invariant, so transforming the control points is exact
+    Object3D *transformed(const Matrix4f &m) const override {
+        std::vector<std::vector<Vector3f>> points = controls;
+        for (auto &row : points) {
+            for (auto &point : row) {
+                point = (m * Vector4f(point, 1)).xyz();
+            }
+        }
+        return new BezierSurface(points, material);
+    }
+
     bool intersect(const Ray &r, Hit &h, float tmin) const override {
         // solve L(t) - P(u, v) = 0 using Newton's method
         float t = 0, u = 0.5, v = 0.5;
@@ -6,84 +6,30 @@
 
 #include <vecmath.h>
 #include "object3d.hpp"
+#include "instance.hpp"
 
-#define DegreesToRadians(x) ((M_PI * x) / 180.0f)
-
-// transforms a 3D point using a matrix, returning a 3D point
-static Vector3f transformPoint(const Matrix4f &mat, const Vector3f &point) {
-    return (mat * Vector4f(point, 1)).xyz();
-}
-
-// transform a 3D directino using a matrix, returning a direction
-static Vector3f transformDirection(const Matrix4f &mat, const Vector3f &dir) {
-    return (mat * Vector4f(dir, 0)).xyz();
-}
-
-class Transform : public Object3D {
+// Instance owning its object
+class Transform : public Instance {
 public:
     Transform() = delete;
 
-    Transform(const Matrix4f &m, Object3D *obj) : o(obj), Object3D(obj->material) {
-        transform = m.inverse();
-
-        setNewAABB(m, o->getAABB());
-    }
+    Transform(const Matrix4f &m, Object3D *obj) : Instance(obj, m) {}
 
     Transform(Object3D* obj, const Vector3f &scale, const Vector3f &translate, float rotateX, float rotateY, float rotateZ)
-        : o(obj), Object3D(obj->material)  {
-        Matrix4f m = Matrix4f::identity();
-
-        m = m * Matrix4f::translation(translate);
-        m = m * Matrix4f::rotateX(DegreesToRadians(rotateX));
-        m = m * Matrix4f::rotateY(DegreesToRadians(rotateY));
-        m = m * Matrix4f::rotateZ(DegreesToRadians(rotateZ));
-        m = m * Matrix4f::scaling(scale.x(), scale.y(), scale.z());
+        : Instance(obj, scale, translate, rotateX, rotateY, rotateZ) {}
 
-        transform = m.inverse();
-
-        setNewAABB(m, o->getAABB());
-    }
-
-    ~Transform() {
+    ~Transform() override {
         delete o;
     }
 
-    virtual bool intersect(const Ray &r, Hit &h, float tmin) const override {
-        Vector3f trSource = transformPoint(transform, r.getOrigin());
-        Vector3f trDirection = transformDirection(transform, r.getDirection());
-        Ray tr(trSource, trDirection);
-        bool inter = o->intersect(tr, h, tmin);
-        if (inter) {
-            h.set(h.getT(), h.getMaterial(), transformDirection(transform.transposed(), h.getNormal()).normalized());
-        }
-        return inter;
-    }
-
-    AABB getAABB() const override {
-        return newAABB;
-    }
-
-protected:
-    Object3D *o; //un-transformed object
-    Matrix4f transform;
-    AABB newAABB;
-
-    void setNewAABB(const Matrix4f &m, const AABB &aabb) {
-        Vector3f min = aabb.getMin(), max = aabb.getMax();
-        Vector3f vertices[8] = {
-                Vector3f(min.x(), min.y(), min.z()),
-                Vector3f(min.x(), min.y(), max.z()),
-                Vector3f(min.x(), max.y(), min.z()),
-                Vector3f(min.x(), max.y(), max.z()),
-                Vector3f(max.x(), min.y(), min.z()),
-                Vector3f(max.x(), min.y(), max.z()),
-                Vector3f(max.x(), max.y(), min.z()),
-                Vector3f(max.x(), max.y(), max.z())
-        };
-        for (auto & vertex : vertices) {
-            vertex = transformPoint(m, vertex);
-            newAABB.expand(vertex);
+    // Flatten into a world-space copy of the object, so that rays never touch the matrix.
+    // Returns nullptr for mirroring matrices and objects that cannot be baked.
+    Object3D *bake() const {
+        Matrix4f m = getMatrix();
+        if (m.determinant() <= 0) {
+            return nullptr;
         }
+        return o->transformed(m);
     }
 };
 
@@ -45,7 +45,7 @@ public:
 		float v = Vector3f::dot(s_e1, d) / deno;
 		if (t > tmin && u >= 0 && v >= 0 && u + v <= 1) {
 			if (t < hit.getT()) {
-				hit.set(t, material, normal);
+				hit.record(t, this, -1, u, v);
 				return true;
 
 			}
@@ -53,10 +53,20 @@ public:
 		return false;
 	}
 
+	void computeSurface(const Ray &ray, Hit &hit) const override {
+		hit.setSurface(material, normal);
+	}
+
     AABB getAABB() const override {
         return aabb;
     }
 
+    Object3D *transformed(const Matrix4f &m) const override {
+        return new Triangle((m * Vector4f(vertices[0], 1)).xyz(),
+                            (m * Vector4f(vertices[1], 1)).xyz(),
+                            (m * Vector4f(vertices[2], 1)).xyz(), material);
+    }
+
 	Vector3f normal;
 	Vector3f vertices[3];
 protected:
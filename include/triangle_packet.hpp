@@ -0,0 +1,131 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_TRIANGLE_PACKET_HPP
+#define RAYTRACING_TRIANGLE_PACKET_HPP
+
+#include <cmath>
+#include <Vector3f.h>
+
+#include "simd_lane.hpp"
+
+// Groups of triangles stored as structure of arrays, so that one ray can be tested
+// against all of them at once: 8 lanes with AVX2, 4 lanes with SSE2 or plain C++.
+// The struct is not over-aligned and loads are unaligned, since std::vector does not
+// honor extended alignment before C++17.
+const int TrianglePacketWidth = PacketWidth;
+
+struct TrianglePacket {
+    float v0[3][TrianglePacketWidth];
+    float e1[3][TrianglePacketWidth];
+    float e2[3][TrianglePacketWidth];
+
+    // Unused lanes hold degenerate triangles, which never report a hit
+    TrianglePacket() {
+        for (int i = 0; i < 3; i++) {
+            for (int lane = 0; lane < TrianglePacketWidth; lane++) {
+                v0[i][lane] = e1[i][lane] = e2[i][lane] = 0;
+            }
+        }
+    }
+
+    void set(int lane, const Vector3f &a, const Vector3f &b, const Vector3f &c) {
+        for (int i = 0; i < 3; i++) {
+            v0[i][lane] = a[i];
+            e1[i][lane] = b[i] - a[i];
+            e2[i][lane] = c[i] - a[i];
+        }
+    }
+};
+
+// Moller-Trumbore test of a ray against every triangle in the packet. Returns a bit mask
+// of the lanes hit with tmin < t < tmax, whose t and barycentric coordinates are written to
+// ts, us and vs (arrays of TrianglePacketWidth floats, aligned to 32 bytes).
+inline int intersectTrianglePacketLanes(const TrianglePacket &p, const Vector3f &o, const Vector3f &d,
+                                        float tmin, float tmax, float *ts, float *us, float *vs) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    Lane dx = LANE_SET1(d[0]), dy = LANE_SET1(d[1]), dz = LANE_SET1(d[2]);
+    Lane e1x = LANE_LOAD(p.e1[0]), e1y = LANE_LOAD(p.e1[1]), e1z = LANE_LOAD(p.e1[2]);
+    Lane e2x = LANE_LOAD(p.e2[0]), e2y = LANE_LOAD(p.e2[1]), e2z = LANE_LOAD(p.e2[2]);
+    Lane sx = LANE_SUB(LANE_SET1(o[0]), LANE_LOAD(p.v0[0]));
+    Lane sy = LANE_SUB(LANE_SET1(o[1]), LANE_LOAD(p.v0[1]));
+    Lane sz = LANE_SUB(LANE_SET1(o[2]), LANE_LOAD(p.v0[2]));
+
+    // rd_e2 = d x e2, s_e1 = s x e1
+    Lane px = LANE_SUB(LANE_MUL(dy, e2z), LANE_MUL(dz, e2y));
+    Lane py = LANE_SUB(LANE_MUL(dz, e2x), LANE_MUL(dx, e2z));
+    Lane pz = LANE_SUB(LANE_MUL(dx, e2y), LANE_MUL(dy, e2x));
+    Lane qx = LANE_SUB(LANE_MUL(sy, e1z), LANE_MUL(sz, e1y));
+    Lane qy = LANE_SUB(LANE_MUL(sz, e1x), LANE_MUL(sx, e1z));
+    Lane qz = LANE_SUB(LANE_MUL(sx, e1y), LANE_MUL(sy, e1x));
+
+    Lane deno = LANE_ADD(LANE_ADD(LANE_MUL(px, e1x), LANE_MUL(py, e1y)), LANE_MUL(pz, e1z));
+    Lane invDeno = LANE_DIV(LANE_SET1(1.0f), deno);
+    Lane t = LANE_MUL(LANE_ADD(LANE_ADD(LANE_MUL(qx, e2x), LANE_MUL(qy, e2y)), LANE_MUL(qz, e2z)), invDeno);
+    Lane b1 = LANE_MUL(LANE_ADD(LANE_ADD(LANE_MUL(px, sx), LANE_MUL(py, sy)), LANE_MUL(pz, sz)), invDeno);
+    Lane b2 = LANE_MUL(LANE_ADD(LANE_ADD(LANE_MUL(qx, dx), LANE_MUL(qy, dy)), LANE_MUL(qz, dz)), invDeno);
+
+    Lane zero = LANE_SET1(0.0f);
+    Lane mask = LANE_NE(deno, zero);
+    mask = LANE_AND(mask, LANE_GT(t, LANE_SET1(tmin)));
+    mask = LANE_AND(mask, LANE_LT(t, LANE_SET1(tmax)));
+    mask = LANE_AND(mask, LANE_GE(b1, zero));
+    mask = LANE_AND(mask, LANE_GE(b2, zero));
+    mask = LANE_AND(mask, LANE_GE(LANE_SET1(1.0f), LANE_ADD(b1, b2)));
+
+    LANE_STORE(ts, t);
+    LANE_STORE(us, b1);
+    LANE_STORE(vs, b2);
+    return LANE_MASK(mask);
+#else
+    int bits = 0;
+    for (int lane = 0; lane < TrianglePacketWidth; lane++) {
+        Vector3f e1(p.e1[0][lane], p.e1[1][lane], p.e1[2][lane]);
+        Vector3f e2(p.e2[0][lane], p.e2[1][lane], p.e2[2][lane]);
+        Vector3f s = o - Vector3f(p.v0[0][lane], p.v0[1][lane], p.v0[2][lane]);
+        Vector3f rd_e2 = Vector3f::cross(d, e2);
+        Vector3f s_e1 = Vector3f::cross(s, e1);
+        float deno = Vector3f::dot(rd_e2, e1);
+        if (deno == 0) continue;
+
+        float invDeno = 1.0f / deno;
+        ts[lane] = Vector3f::dot(s_e1, e2) * invDeno;
+        us[lane] = Vector3f::dot(rd_e2, s) * invDeno;
+        vs[lane] = Vector3f::dot(s_e1, d) * invDeno;
+        if (ts[lane] > tmin && ts[lane] < tmax && us[lane] >= 0 && vs[lane] >= 0 && us[lane] + vs[lane] <= 1) {
+            bits |= 1 << lane;
+        }
+    }
+    return bits;
+#endif
+}
+
+// Whether d points against the normal e1 x e2 of the triangle in lane, i.e. at the front
+// of a counterclockwise triangle
+inline bool isFrontFacing(const TrianglePacket &p, int lane, const Vector3f &d) {
+    float e1[3] = {p.e1[0][lane], p.e1[1][lane], p.e1[2][lane]};
+    float e2[3] = {p.e2[0][lane], p.e2[1][lane], p.e2[2][lane]};
+    const float *direction = &d[0];
+    float nx = e1[1] * e2[2] - e1[2] * e2[1];
+    float ny = e1[2] * e2[0] - e1[0] * e2[2];
+    float nz = e1[0] * e2[1] - e1[1] * e2[0];
+    return direction[0] * nx + direction[1] * ny + direction[2] * nz < 0;
+}
+
+// Lane of the closest hit with tmin < t < tmax, or -1. On a hit, tmax, u and v are updated.
+inline int intersectTrianglePacket(const TrianglePacket &p, const Vector3f &o, const Vector3f &d,
+                                   float tmin, float &tmax, float &u, float &v) {
+    alignas(32) float ts[TrianglePacketWidth], us[TrianglePacketWidth], vs[TrianglePacketWidth];
+    int bits = intersectTrianglePacketLanes(p, o, d, tmin, tmax, ts, us, vs);
+    if (bits == 0) {
+        return -1;
+    }
+
+    int best = closestLane(bits, ts, tmax);
+    u = us[best];
+    v = vs[best];
+    return best;
+}
+
+#endif //RAYTRACING_TRIANGLE_PACKET_HPP
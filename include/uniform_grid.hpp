@@ -0,0 +1,226 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_UNIFORM_GRID_HPP
+#define RAYTRACING_UNIFORM_GRID_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "accelerator.hpp"
+
+// Regular grid of cells over the bounds of the objects, each listing the objects whose
+// bounds overlap it. Rays walk the cells they pierce front to back with a 3D-DDA
+// (Amanatides and Woo, "A Fast Voxel Traversal Algorithm for Ray Tracing", 1987) and stop
+// at the first cell that contains the closest hit so far. Suits many objects of similar
+// size spread evenly, where it needs no hierarchy to descend.
+class UniformGrid : public Accelerator {
+public:
+    UniformGrid() = delete;
+
+    // About density cells per object, split between the axes in proportion to the extent
+    explicit UniformGrid(const std::vector<Object3D*> &objects, float density = DefaultDensity) {
+        build(objects, density);
+    }
+
+    bool intersect(const Ray &r, Hit &h, float tmin) const override {
+        return traverse(r, h, tmin, [&](const Object3D *object) {
+            return object->intersect(r, h, tmin);
+        }, false);
+    }
+
+    bool occluded(const Ray &r, float tmin, float tmax) const override {
+        Hit h(tmax, nullptr, Vector3f::ZERO);
+        return traverse(r, h, tmin, [&](const Object3D *object) {
+            return object->occluded(r, tmin, tmax);
+        }, true);
+    }
+
+    AABB getAABB() const override {
+        return aabb;
+    }
+
+    size_t getMemoryUsage() const override {
+        return sizeof(UniformGrid) + cellStart.size() * sizeof(int) + cellObjects.size() * sizeof(Object3D*)
+               + unbounded.size() * sizeof(Object3D*);
+    }
+
+    int getResolution(int axis) const {
+        return resolution[axis];
+    }
+
+    // Sum over all cells of the objects listed in them
+    int getReferenceCount() const {
+        return (int) cellObjects.size();
+    }
+
+private:
+    static constexpr float DefaultDensity = 2.0f;
+    static const int MaxResolution = 256;
+
+    float min[3], cellSize[3], invCellSize[3];
+    int resolution[3] = {0, 0, 0};
+    std::vector<int> cellStart;                 // objects of cell i are cellObjects[cellStart[i] .. cellStart[i + 1])
+    std::vector<const Object3D*> cellObjects;
+    std::vector<const Object3D*> unbounded;
+    AABB aabb;
+
+    // Boxes are culled against h.getT(). leaf(object) tests an object, and with anyHit the
+    // traversal ends at the first object that reports a hit.
+    template <typename Leaf>
+    bool traverse(const Ray &r, const Hit &h, float tmin, Leaf leaf, bool anyHit) const {
+        bool result = false;
+        for (auto object : unbounded) {
+            result |= leaf(object);
+            if (result && anyHit) return true;
+        }
+        if (cellStart.empty()) {
+            return result;
+        }
+
+        const float *o = &r.getOrigin()[0];
+        const float *d = &r.getDirection()[0];
+        const float *invD = r.getInvDirection();
+
+        // Clip the ray to the grid
+        float t0 = tmin, t1 = h.getT();
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = min[axis], hi = min[axis] + resolution[axis] * cellSize[axis];
+            float tNear = ((r.getSign(axis) ? hi : lo) - o[axis]) * invD[axis];
+            float tFar = ((r.getSign(axis) ? lo : hi) - o[axis]) * invD[axis];
+            t0 = tNear > t0 ? tNear : t0;
+            t1 = tFar < t1 ? tFar : t1;
+        }
+        if (t0 > t1) {
+            return result;
+        }
+
+        // Cell of the entry point, and the distance to the next cell boundary on each axis
+        int cell[3], step[3], stop[3];
+        float tNext[3], tDelta[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float p = o[axis] + t0 * d[axis];
+            cell[axis] = std::max(0, std::min(resolution[axis] - 1, (int) ((p - min[axis]) * invCellSize[axis])));
+            if (d[axis] > 0) {
+                step[axis] = 1;
+                stop[axis] = resolution[axis];
+                tNext[axis] = (min[axis] + (cell[axis] + 1) * cellSize[axis] - o[axis]) * invD[axis];
+                tDelta[axis] = cellSize[axis] * invD[axis];
+            } else if (d[axis] < 0) {
+                step[axis] = -1;
+                stop[axis] = -1;
+                tNext[axis] = (min[axis] + cell[axis] * cellSize[axis] - o[axis]) * invD[axis];
+                tDelta[axis] = -cellSize[axis] * invD[axis];
+            } else {
+                step[axis] = 0;
+                stop[axis] = -1;
+                tNext[axis] = MAXFLOAT;
+                tDelta[axis] = MAXFLOAT;
+            }
+        }
+
+        while (true) {
+            int index = cell[0] + resolution[0] * (cell[1] + resolution[1] * cell[2]);
+            for (int i = cellStart[index]; i < cellStart[index + 1]; i++) {
+                result |= leaf(cellObjects[i]);
+                if (result && anyHit) return true;
+            }
+
+            int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+            // Hits lie in every cell their object overlaps, so one inside this cell beats all later cells
+            if (h.getT() <= tNext[axis] || tNext[axis] > t1) break;
+            cell[axis] += step[axis];
+            if (cell[axis] == stop[axis]) break;
+            tNext[axis] += tDelta[axis];
+        }
+        return result;
+    }
+
+    // Cells covered by box on axis, clamped to the grid
+    void cellRange(const AABB &box, int axis, int &first, int &last) const {
+        Interval interval = box.getAxis(axis);
+        first = (int) std::floor((interval.getMin() - min[axis]) * invCellSize[axis]);
+        last = (int) std::floor((interval.getMax() - min[axis]) * invCellSize[axis]);
+        first = std::max(0, std::min(resolution[axis] - 1, first));
+        last = std::max(0, std::min(resolution[axis] - 1, last));
+    }
+
+    void build(const std::vector<Object3D*> &objects, float density) {
+        std::vector<const Object3D*> bounded;
+        std::vector<AABB> boxes;
+        AABB bounds;
+        for (auto object : objects) {
+            AABB box = object->getAABB();
+            aabb.expand(box);
+            if (isBounded(box)) {
+                bounded.push_back(object);
+                boxes.push_back(box);
+                bounds.expand(box);
+            } else {
+                unbounded.push_back(object);
+            }
+        }
+        if (bounded.empty()) {
+            return;
+        }
+
+        // Flat axes get a nominal extent, so that cells never have zero size
+        float extent[3], largest = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            extent[axis] = bounds.getAxis(axis).getLength();
+            largest = std::max(largest, extent[axis]);
+        }
+        float volume = 1;
+        for (int axis = 0; axis < 3; axis++) {
+            extent[axis] = std::max(extent[axis], largest * 1e-3f + 1e-6f);
+            volume *= extent[axis];
+        }
+        float cellsPerLength = std::cbrt(density * bounded.size() / volume);
+        for (int axis = 0; axis < 3; axis++) {
+            min[axis] = bounds.getAxis(axis).getMin();
+            resolution[axis] = std::max(1, std::min(MaxResolution, (int) std::round(extent[axis] * cellsPerLength)));
+            cellSize[axis] = extent[axis] / resolution[axis];
+            invCellSize[axis] = 1 / cellSize[axis];
+        }
+
+        // Count the objects per cell, then fill the cells in a second pass
+        int cellCount = resolution[0] * resolution[1] * resolution[2];
+        cellStart.assign(cellCount + 1, 0);
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t i = 0; i < bounded.size(); i++) {
+                int first[3], last[3];
+                for (int axis = 0; axis < 3; axis++) {
+                    cellRange(boxes[i], axis, first[axis], last[axis]);
+                }
+                for (int z = first[2]; z <= last[2]; z++) {
+                    for (int y = first[1]; y <= last[1]; y++) {
+                        for (int x = first[0]; x <= last[0]; x++) {
+                            int index = x + resolution[0] * (y + resolution[1] * z);
+                            if (pass == 0) {
+                                cellStart[index + 1]++;
+                            } else {
+                                cellObjects[cellStart[index]++] = bounded[i];
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (pass == 0) {
+                for (int index = 0; index < cellCount; index++) {
+                    cellStart[index + 1] += cellStart[index];
+                }
+                cellObjects.resize(cellStart[cellCount]);
+            } else {
+                // Filling advanced every start to the start of the next cell
+                for (int index = cellCount; index > 0; index--) {
+                    cellStart[index] = cellStart[index - 1];
+                }
+                cellStart[0] = 0;
+            }
+        }
+    }
+};
+
+#endif //RAYTRACING_UNIFORM_GRID_HPP
@@ -0,0 +1,158 @@
+//
+// Implemented independently
+//
+
+#ifndef RAYTRACING_WAVEFRONT_HPP
+#define RAYTRACING_WAVEFRONT_HPP
+
+#include <chrono>
+#include <vector>
+#include "cache_simulator.hpp"
+#include "flat_bvh.hpp"
+#include "group.hpp"
+#include "hit.hpp"
+#include "instance.hpp"
+#include "material.hpp"
+#include "random.hpp"
+#include "ray.hpp"
+#include "ray_sorter.hpp"
+#include "scene.hpp"
+
+// Traces a batch of paths breadth first: the rays of one bounce are all traced before any ray
+// of the next. Camera rays arrive in pixel order and are traced as they are, but the rays
+// materials scatter point every which way. With sorting enabled they are traced in the order
+// of sortRays(), so that rays traced one after another find the nodes and primitives
+// their predecessors left in the caches. Computes the same radiance as tracing each path
+// on its own with the recursion in Renderer::trace.
+class WavefrontTracer {
+public:
+    static const int MaxDepth = 50;
+
+    // Counted per bounce, the camera rays being depth 0
+    struct DepthStatistics {
+        long long rays = 0;
+        double traceSeconds = 0;
+        double sortSeconds = 0;
+        long long nodeAccesses = 0;     // only with a node cache and a FlatBVH
+        long long nodeHits = 0;
+    };
+
+    explicit WavefrontTracer(const Scene *scene, bool sortSecondary = false)
+        : scene(scene), sortSecondary(sortSecondary) {}
+
+    // Traces the rays of every bounce once more through the FlatBVH of the scene, feeding
+    // the nodes they visit to nodeCache in the same order, emptied at each bounce. Not
+    // counted in the trace time. nullptr turns it off.
+    void setNodeCache(CacheSimulator *cache) {
+        nodeCache = cache;
+    }
+
+    const std::vector<DepthStatistics> &getStatistics() const {
+        return statistics;
+    }
+
+    void clearStatistics() {
+        statistics.clear();
+    }
+
+    // Radiance arriving along each camera ray
+    void trace(const std::vector<Ray> &cameraRays, std::vector<Vector3f> &colors) {
+        const Object3D *accelerator = scene->getAccelerator();
+        auto flat = dynamic_cast<const FlatBVH*>(accelerator);
+        colors.assign(cameraRays.size(), Vector3f::ZERO);
+
+        std::vector<Ray> rays = cameraRays, nextRays;
+        std::vector<Path> paths, nextPaths;
+        for (int i = 0; i < (int) rays.size(); i++) {
+            paths.push_back({Vector3f(1, 1, 1), i});
+        }
+        std::vector<Hit> hits;
+        std::vector<char> results;
+        std::vector<int> order;
+        for (int depth = 0; !rays.empty(); depth++) {
+            if ((int) statistics.size() <= depth) {
+                statistics.emplace_back();
+            }
+            DepthStatistics &stats = statistics[depth];
+            int count = (int) rays.size();
+            stats.rays += count;
+
+            if (sortSecondary && depth > 0) {
+                auto start = std::chrono::steady_clock::now();
+                sortRays(rays.data(), count, order);
+                nextRays.clear();
+                nextPaths.clear();
+                for (int i : order) {
+                    nextRays.push_back(rays[i]);
+                    nextPaths.push_back(paths[i]);
+                }
+                rays.swap(nextRays);
+                paths.swap(nextPaths);
+                stats.sortSeconds += secondsSince(start);
+            }
+
+            hits.assign(count, Hit());
+            results.resize(count);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; i++) {
+                results[i] = accelerator->intersect(rays[i], hits[i], 0);
+            }
+            stats.traceSeconds += secondsSince(start);
+
+            if (nodeCache != nullptr && flat != nullptr) {
+                nodeCache->reset();
+                for (int i = 0; i < count; i++) {
+                    Hit hit;
+                    flat->intersect(rays[i], hit, 0, *nodeCache);
+                }
+                stats.nodeAccesses += nodeCache->getAccesses();
+                stats.nodeHits += nodeCache->getHits();
+            }
+
+            nextRays.clear();
+            nextPaths.clear();
+            for (int i = 0; i < count; i++) {
+                Path &path = paths[i];
+                if (!results[i]) {
+                    colors[path.index] = path.throughput * scene->getBackgroundColor();
+                    continue;
+                }
+                computeHitSurface(rays[i], hits[i]);
+
+                Vector3f attenuation;
+                Ray scattered(Vector3f(0), Vector3f(0));
+                Vector3f emission = hits[i].getMaterial()->scatter(rays[i], hits[i], attenuation, scattered,
+                                                                   scene->getLights());
+                if (emission != Vector3f::ZERO) {
+                    colors[path.index] = path.throughput * emission;
+                    continue;
+                }
+                // Russian roulette, and a bound on the path length
+                if (attenuation.length() < rand01() || depth >= MaxDepth) {
+                    continue;
+                }
+                nextRays.push_back(scattered);
+                nextPaths.push_back({path.throughput * attenuation, path.index});
+            }
+            rays.swap(nextRays);
+            paths.swap(nextPaths);
+        }
+    }
+
+private:
+    struct Path {
+        Vector3f throughput;    // product of the attenuations so far
+        int index;              // of the camera ray
+    };
+
+    const Scene *scene;
+    bool sortSecondary;
+    CacheSimulator *nodeCache = nullptr;
+    std::vector<DepthStatistics> statistics;
+
+    static double secondsSince(const std::chrono::steady_clock::time_point &start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+#endif //RAYTRACING_WAVEFRONT_HPP
@@ -0,0 +1,1144 @@
+//
+// Implemented independently
+//
+// Micro-benchmarks for the intersection kernels and acceleration structures.
+// All of them run on a single thread, so the numbers are per core.
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bvh_node.hpp"
+#include "camera.hpp"
+#include "compressed_bvh.hpp"
+#include "constant_medium.hpp"
+#include "flat_bvh.hpp"
+#include "instance.hpp"
+#include "kd_tree.hpp"
+#include "material.hpp"
+#include "mesh.hpp"
+#include "obj_loader.hpp"
+#include "random.hpp"
+#include "ray_batch.hpp"
+#include "scene.hpp"
+#include "scene_provider.hpp"
+#include "triangle.hpp"
+#include "triangle_packet.hpp"
+#include "uniform_grid.hpp"
+#include "wavefront.hpp"
+
+using namespace std;
+
+static double secondsSince(const chrono::steady_clock::time_point &start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Small random triangles in the unit cube, hit by random rays crossing the cube
+static void benchmarkTriangles() {
+    const int triangleCount = 4096;
+    const int rayCount = 2048;
+
+    vector<Triangle> triangles;
+    triangles.reserve(triangleCount);
+    for (int i = 0; i < triangleCount; i++) {
+        Vector3f a(rand01(), rand01(), rand01());
+        triangles.emplace_back(a, a + 0.1f * randomUnitVector3d(), a + 0.1f * randomUnitVector3d(), nullptr);
+    }
+
+    vector<TrianglePacket> packets(triangleCount / TrianglePacketWidth);
+    for (int i = 0; i < triangleCount; i++) {
+        const Triangle &tri = triangles[i];
+        packets[i / TrianglePacketWidth].set(i % TrianglePacketWidth, tri.vertices[0], tri.vertices[1], tri.vertices[2]);
+    }
+
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f origin = Vector3f(0.5f, 0.5f, 0.5f) + 2 * randomUnitVector3d();
+        Vector3f target(rand01(), rand01(), rand01());
+        rays.emplace_back(origin, (target - origin).normalized());
+    }
+
+    int scalarHits = 0;
+    auto start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        Hit hit;
+        for (const Triangle &tri : triangles) {
+            scalarHits += tri.intersect(ray, hit, 0);
+        }
+    }
+    double scalarSeconds = secondsSince(start);
+
+    int packetHits = 0;
+    start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        float tmax = 1e38, u, v;
+        for (const TrianglePacket &packet : packets) {
+            packetHits += intersectTrianglePacket(packet, ray.getOrigin(), ray.getDirection(), 0, tmax, u, v) >= 0;
+        }
+    }
+    double packetSeconds = secondsSince(start);
+
+    double tests = (double) triangleCount * rayCount;
+    cout << "Triangle::intersect:     " << tests / scalarSeconds / 1e6 << " M triangles/s ("
+         << scalarHits << " closer hits)" << endl;
+    cout << "TrianglePacket (" << TrianglePacketWidth << " wide): " << tests / packetSeconds / 1e6
+         << " M triangles/s (" << packetHits << " closer hits)" << endl;
+}
+
+// Slab test as it was before rays carried their reciprocal direction, for comparison
+static bool intersectBoxDividing(const AABB &box, const Ray &r, float tmin, float tmax) {
+    for (int i = 0; i < 3; i++) {
+        float invD = 1.0f / r.getDirection()[i];
+        float tNear = (box.getMin()[i] - r.getOrigin()[i]) * invD;
+        float tFar = (box.getMax()[i] - r.getOrigin()[i]) * invD;
+        if (tNear > tFar) std::swap(tNear, tFar);
+        tmin = tNear > tmin ? tNear : tmin;
+        tmax = tFar < tmax ? tFar : tmax;
+        if (tmin > tmax) return false;
+    }
+    return true;
+}
+
+// Small random boxes in the unit cube, tested against random rays crossing the cube
+static void benchmarkBoxes() {
+    const int boxCount = 4096;
+    const int rayCount = 4096;
+
+    vector<AABB> boxes;
+    for (int i = 0; i < boxCount; i++) {
+        Vector3f a(rand01(), rand01(), rand01());
+        boxes.emplace_back(a, a + 0.1f * Vector3f(rand01(), rand01(), rand01()));
+    }
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f origin = Vector3f(0.5f, 0.5f, 0.5f) + 2 * randomUnitVector3d();
+        Vector3f target(rand01(), rand01(), rand01());
+        rays.emplace_back(origin, (target - origin).normalized());
+    }
+
+    int dividingHits = 0;
+    auto start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        for (const AABB &box : boxes) {
+            dividingHits += intersectBoxDividing(box, ray, 0, 1e38);
+        }
+    }
+    double dividingSeconds = secondsSince(start);
+
+    int hits = 0;
+    start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        for (const AABB &box : boxes) {
+            hits += box.intersect(ray, 0, 1e38);
+        }
+    }
+    double seconds = secondsSince(start);
+
+    double tests = (double) boxCount * rayCount;
+    cout << "Dividing slab test: " << tests / dividingSeconds / 1e6 << " M node tests/s (" << dividingHits
+         << " hits)" << endl;
+    cout << "AABB::intersect:    " << tests / seconds / 1e6 << " M node tests/s (" << hits << " hits)" << endl;
+}
+
+// Small primitives in the unit cube, traced through a BVHNode tree with virtual leaf calls
+// and through the flattened copy of it with sphere and quad packets. typeCount 3 mixes
+// spheres, quads and triangles, 1 makes only spheres.
+static void benchmarkFlat(int typeCount) {
+    const int primitiveCount = 30000;
+    const int rayCount = 200000;
+
+    vector<Object3D*> objects;
+    for (int i = 0; i < primitiveCount; i++) {
+        Vector3f a(rand01(), rand01(), rand01());
+        Vector3f u = 0.02f * randomUnitVector3d();
+        if (i % typeCount == 0) {
+            objects.push_back(new Sphere(a, 0.01f, nullptr));
+        } else if (i % typeCount == 1) {
+            objects.push_back(new Quad(a, u, Vector3f::cross(u, randomUnitVector3d()).normalized() * 0.02f, nullptr));
+        } else {
+            objects.push_back(new Triangle(a, a + u, a + 0.02f * randomUnitVector3d(), nullptr));
+        }
+    }
+    // Shuffle the heap, as objects of a real scene are not allocated in BVH order
+    for (int i = primitiveCount - 1; i > 0; i--) {
+        swap(objects[i], objects[rand() % (i + 1)]);
+    }
+    auto bvh = new BVHNode(objects);
+    auto flat = new FlatBVH(bvh);
+    cout << (typeCount == 1 ? "Spheres: " : "Spheres, quads and triangles: ")
+         << (float) flat->getMemoryUsage() / primitiveCount << " bytes/primitive flat, "
+         << flat->getPacketOccupancy() * 100 << "% of packet lanes used" << endl;
+
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f origin = Vector3f(0.5f, 0.5f, 0.5f) + 2 * randomUnitVector3d();
+        Vector3f target(rand01(), rand01(), rand01());
+        rays.emplace_back(origin, (target - origin).normalized());
+    }
+
+    const Object3D *structures[] = {bvh, flat};
+    const char *names[] = {"BVHNode: ", "FlatBVH: "};
+    for (int s = 0; s < 2; s++) {
+        int hits = 0;
+        double distance = 0;
+        auto start = chrono::steady_clock::now();
+        for (const Ray &ray : rays) {
+            Hit hit;
+            if (structures[s]->intersect(ray, hit, 0)) {
+                hits++;
+                distance += hit.getT();
+            }
+        }
+        cout << names[s] << rayCount / secondsSince(start) / 1e6 << " M rays/s (" << hits << " hits, mean t "
+             << distance / hits << ")" << endl;
+    }
+    delete flat;
+    delete bvh;
+    for (auto object : objects) {
+        delete object;
+    }
+}
+
+// Incoherent rays through a flat BVH over many more spheres than fit into the caches,
+// one ray at a time and interleaved in groups of several widths
+static void benchmarkInterleaved() {
+    const int sphereCount = 1000000;
+    const int rayCount = 200000;
+
+    vector<Object3D*> objects;
+    for (int i = 0; i < sphereCount; i++) {
+        objects.push_back(new Sphere(Vector3f(rand01(), rand01(), rand01()), 0.0024f, nullptr));
+    }
+    auto bvh = new BVHNode(objects);
+    auto flat = new FlatBVH(bvh);
+    delete bvh;
+    cout << "Flat BVH: " << flat->getMemoryUsage() / 1e6 << " MB" << endl;
+
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f origin(rand01(), rand01(), rand01());
+        rays.emplace_back(origin, randomUnitVector3d());
+    }
+
+    int hits = 0;
+    double distance = 0;
+    auto start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        Hit hit;
+        if (flat->intersect(ray, hit, 1e-4f)) {
+            hits++;
+            distance += hit.getT();
+        }
+    }
+    cout << "One ray at a time: " << rayCount / secondsSince(start) / 1e6 << " M rays/s (" << hits
+         << " hits, mean t " << distance / hits << ")" << endl;
+
+    vector<Hit> batchHits(rayCount);
+    unique_ptr<bool[]> results(new bool[rayCount]);
+    for (int width : {1, 4, 8, 16, 32}) {
+        fill(batchHits.begin(), batchHits.end(), Hit());
+        start = chrono::steady_clock::now();
+        flat->intersect(rays.data(), batchHits.data(), results.get(), rayCount, 1e-4f, width);
+        double seconds = secondsSince(start);
+        hits = 0;
+        distance = 0;
+        for (int i = 0; i < rayCount; i++) {
+            if (results[i]) {
+                hits++;
+                distance += batchHits[i].getT();
+            }
+        }
+        cout << "Interleaved, " << width << " rays: " << rayCount / seconds / 1e6 << " M rays/s (" << hits
+             << " hits, mean t " << distance / hits << ")" << endl;
+    }
+
+    start = chrono::steady_clock::now();
+    int occludedCount = 0;
+    for (const Ray &ray : rays) {
+        occludedCount += flat->occluded(ray, 1e-4f, 0.05f);
+    }
+    double singleSeconds = secondsSince(start);
+    start = chrono::steady_clock::now();
+    flat->occluded(rays.data(), results.get(), rayCount, 1e-4f, 0.05f);
+    double batchSeconds = secondsSince(start);
+    int batchCount = 0;
+    for (int i = 0; i < rayCount; i++) {
+        batchCount += results[i];
+    }
+    cout << "Occluded, one at a time: " << rayCount / singleSeconds / 1e6 << " M rays/s (" << occludedCount
+         << "), interleaved: " << rayCount / batchSeconds / 1e6 << " M rays/s (" << batchCount << ")" << endl;
+
+    delete flat;
+    for (auto object : objects) {
+        delete object;
+    }
+}
+
+// Diffuse paths through a cloud of small spheres under an area light, traced bounce by bounce
+// through a flat BVH, once in the order the rays were scattered in and once sorted
+static void benchmarkCoherence() {
+    const int sphereCount = 300000;
+    const int size = 256;
+    const int samples = 4;
+
+    Scene scene;
+    scene.setCamera(new PerspectiveCamera(Vector3f(0.5f, 0.5f, -1.5f), Vector3f(0, 0, 1), Vector3f(0, 1, 0),
+                                          0, 2, 40, size, size));
+    scene.setBackgroundColor(Vector3f(0.2f, 0.2f, 0.2f));
+    auto white = new ConstantTexture(Vector3f(1, 1, 1));
+    auto gray = new ConstantTexture(Vector3f(0.8f, 0.8f, 0.8f));
+    auto diffuse = new DiffuseMaterial(gray, nullptr);
+    scene.addObject(new Quad(Vector3f(0, 1.5f, 0), Vector3f(1, 0, 0), Vector3f(0, 0, 1),
+                             new EmissiveMaterial(4, white, nullptr)));
+    for (int i = 0; i < sphereCount; i++) {
+        scene.addObject(new Sphere(Vector3f(rand01(), rand01(), rand01()), 0.004f, diffuse));
+    }
+    scene.setFlat(true);
+    scene.buildScene();
+
+    Camera *camera = scene.getCamera();
+    vector<Ray> rays;
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            for (int k = 0; k < samples; k++) {
+                rays.push_back(camera->generateRay(Vector2f(i + rand01(), j + rand01())));
+            }
+        }
+    }
+
+    // Hit rate of a 32 KB cache like L1, fed only the nodes
+    CacheSimulator nodeCache(32 * 1024, 8);
+    vector<WavefrontTracer::DepthStatistics> statistics[2];
+    // The first run only warms up the caches and the allocator
+    for (int run = 0; run < 3; run++) {
+        srand(1);
+        WavefrontTracer tracer(&scene, run == 2);
+        tracer.setNodeCache(&nodeCache);
+        vector<Vector3f> colors;
+        tracer.trace(rays, colors);
+        if (run > 0) {
+            statistics[run - 1] = tracer.getStatistics();
+        }
+    }
+
+    cout << "Depth   Rays   Unsorted: M rays/s  node hits | Sorted: M rays/s  with sort  node hits | Gain" << endl;
+    for (size_t depth = 0; depth < statistics[0].size() && depth < statistics[1].size(); depth++) {
+        const WavefrontTracer::DepthStatistics &a = statistics[0][depth], &b = statistics[1][depth];
+        if (a.rays < 1000) break;
+        double unsortedRate = a.rays / a.traceSeconds / 1e6;
+        double sortedRate = b.rays / b.traceSeconds / 1e6;
+        double withSortRate = b.rays / (b.traceSeconds + b.sortSeconds) / 1e6;
+        printf("%5d %6lld   %17.3f %9.1f%% | %15.3f %10.3f %9.1f%% | %.2fx\n", (int) depth, a.rays, unsortedRate,
+               100.0 * a.nodeHits / a.nodeAccesses, sortedRate, withSortRate, 100.0 * b.nodeHits / b.nodeAccesses,
+               withSortRate / unsortedRate);
+    }
+}
+
+// Random rays through the bounds of the objects, in the order of a camera sweeping a
+// grid of origins (coherent) or in random order, through a flat BVH laid out depth first
+// and in treelets. Node hit rates are those of a 32 KB cache and of a 64 entry TLB of 4 KB
+// pages, fed with the nodes the random rays visit.
+static void compareLayouts(const vector<Object3D*> &objects) {
+    const int rayCount = 250000;
+    const int side = 500;
+
+    AABB box;
+    for (auto object : objects) {
+        box.expand(object->getAABB());
+    }
+    Vector3f center = (box.getMin() + box.getMax()) / 2;
+    float radius = (box.getMax() - box.getMin()).length() / 2;
+
+    vector<Ray> coherent, random;
+    Vector3f eye = center + Vector3f(0, radius, 2 * radius);
+    Vector3f forward = (center - eye).normalized();
+    Vector3f right = Vector3f::cross(forward, Vector3f(0, 1, 0)).normalized();
+    Vector3f up = Vector3f::cross(right, forward);
+    for (int j = 0; j < side; j++) {
+        for (int i = 0; i < side; i++) {
+            Vector3f direction = forward + 0.5f * ((2.0f * i / side - 1) * right + (2.0f * j / side - 1) * up);
+            coherent.emplace_back(eye, direction.normalized());
+        }
+    }
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f origin = center + radius * randomUnitVector3d();
+        Vector3f target = center + 0.5f * radius * randomUnitVector3d();
+        random.emplace_back(origin, (target - origin).normalized());
+    }
+
+    auto bvh = new BVHNode(objects);
+    FlatBVH::Layout layouts[] = {FlatBVH::DepthFirstLayout, FlatBVH::TreeletLayout};
+    const char *names[] = {"Depth first: ", "Treelets:    "};
+    for (int l = 0; l < 2; l++) {
+        auto flat = new FlatBVH(bvh, layouts[l]);
+        double rates[2];
+        int hits[2] = {0, 0};
+        const vector<Ray> *rays[] = {&coherent, &random};
+        for (int s = 0; s < 2; s++) {
+            auto start = chrono::steady_clock::now();
+            for (const Ray &ray : *rays[s]) {
+                Hit hit;
+                hits[s] += flat->intersect(ray, hit, 1e-4f);
+            }
+            rates[s] = rays[s]->size() / secondsSince(start) / 1e6;
+        }
+
+        CacheSimulator cache(32 * 1024, 8), tlb(64 * 4096, 4, 4096);
+        for (const Ray &ray : random) {
+            Hit hit;
+            flat->intersect(ray, hit, 1e-4f, cache);
+            hit = Hit();
+            flat->intersect(ray, hit, 1e-4f, tlb);
+        }
+        printf("%s%8.3f M rays/s coherent (%d hits), %8.3f M rays/s random (%d hits), node hits %.1f%% cache, "
+               "%.1f%% TLB\n", names[l], rates[0], hits[0], rates[1], hits[1], 100 * cache.getHitRate(),
+               100 * tlb.getHitRate());
+        delete flat;
+    }
+    delete bvh;
+}
+
+// The bunny scene's 10x10 bunnies as triangles, and a large height field
+static void benchmarkLayouts() {
+    ObjData data;
+    if (!loadObj("mesh/bunny_1k.obj", data)) {
+        return;
+    }
+    vector<Object3D*> objects;
+    for (int i = -5; i < 5; i++) {
+        for (int j = -5; j < 5; j++) {
+            Matrix4f m = Matrix4f::translation(Vector3f(1.6f * i, -1.1f, 1.6f * j))
+                         * Matrix4f::rotateY(DegreesToRadians(36.0f * (i + j))) * Matrix4f::uniformScaling(3);
+            for (size_t c = 0; c + 2 < data.corners.size(); c += 3) {
+                Vector3f p[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = (m * Vector4f(data.positions[data.corners[c + k].position], 1)).xyz();
+                }
+                objects.push_back(new Triangle(p[0], p[1], p[2], nullptr));
+            }
+        }
+    }
+    cout << "Bunnies, " << objects.size() << " triangles" << endl;
+    compareLayouts(objects);
+    for (auto object : objects) {
+        delete object;
+    }
+    objects.clear();
+
+    const int resolution = 700;
+    auto height = [](int x, int z) {
+        float u = (float) x / resolution, v = (float) z / resolution;
+        return 0.1f * sin(20 * u) * cos(17 * v) + 0.03f * sin(90 * u + 40 * v) + 0.01f * rand01();
+    };
+    vector<Vector3f> grid;
+    for (int z = 0; z <= resolution; z++) {
+        for (int x = 0; x <= resolution; x++) {
+            grid.emplace_back((float) x / resolution, height(x, z), (float) z / resolution);
+        }
+    }
+    for (int z = 0; z < resolution; z++) {
+        for (int x = 0; x < resolution; x++) {
+            const Vector3f *row = &grid[z * (resolution + 1) + x], *next = row + resolution + 1;
+            objects.push_back(new Triangle(row[0], row[1], next[0], nullptr));
+            objects.push_back(new Triangle(row[1], next[1], next[0], nullptr));
+        }
+    }
+    // Shuffle the heap, as objects of a real scene are not allocated in BVH order
+    for (int i = (int) objects.size() - 1; i > 0; i--) {
+        swap(objects[i], objects[rand() % (i + 1)]);
+    }
+    cout << "Height field, " << objects.size() << " triangles" << endl;
+    compareLayouts(objects);
+    for (auto object : objects) {
+        delete object;
+    }
+}
+
+// Visibility queries through the batched Scene API against tracing one ray at a time, over
+// a scene of many small diffuse spheres with a flat BVH
+static void benchmarkBatch() {
+    const int sphereCount = 500000;
+    const int rayCount = 500000;
+
+    Scene scene;
+    scene.setCamera(new PerspectiveCamera(Vector3f(0.5f, 0.5f, -1.5f), Vector3f(0, 0, 1), Vector3f(0, 1, 0)));
+    auto white = new ConstantTexture(Vector3f(1, 1, 1));
+    auto diffuse = new DiffuseMaterial(white, nullptr);
+    scene.addObject(new Quad(Vector3f(0, 1.5f, 0), Vector3f(1, 0, 0), Vector3f(0, 0, 1),
+                             new EmissiveMaterial(4, white, nullptr)));
+    for (int i = 0; i < sphereCount; i++) {
+        scene.addObject(new Sphere(Vector3f(rand01(), rand01(), rand01()), 0.003f, diffuse));
+    }
+    scene.setFlat(true);
+    scene.buildScene();
+
+    RayBatch batch;
+    batch.reserve(rayCount);
+    for (int i = 0; i < rayCount; i++) {
+        batch.add(Ray(Vector3f(rand01(), rand01(), rand01()), randomUnitVector3d()), 0.1f);
+    }
+
+    const Object3D *structure = scene.getAccelerator();
+    int hits = 0, occludedCount = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < rayCount; i++) {
+        Hit hit(batch.getTMax(i), nullptr, Vector3f::ZERO);
+        if (structure->intersect(batch.getRay(i), hit, batch.getTMin())) {
+            computeHitSurface(batch.getRay(i), hit);
+            hits++;
+        }
+    }
+    double seconds = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < rayCount; i++) {
+        occludedCount += structure->occluded(batch.getRay(i), batch.getTMin(), batch.getTMax(i));
+    }
+    double occludedSeconds = secondsSince(start);
+    cout << "One ray at a time: " << rayCount / seconds / 1e6 << " M rays/s closest hit (" << hits << " hits), "
+         << rayCount / occludedSeconds / 1e6 << " M rays/s occluded (" << occludedCount << ")" << endl;
+
+    HitBatch results;
+    for (int threads : {1, 0}) {
+        start = chrono::steady_clock::now();
+        scene.intersect(batch, results, threads);
+        seconds = secondsSince(start);
+        hits = results.getHitCount();
+        start = chrono::steady_clock::now();
+        scene.occluded(batch, results, threads);
+        occludedSeconds = secondsSince(start);
+        cout << (threads == 1 ? "Batch, 1 thread:   " : "Batch, all threads: ") << rayCount / seconds / 1e6
+             << " M rays/s closest hit (" << hits << " hits), " << rayCount / occludedSeconds / 1e6
+             << " M rays/s occluded (" << results.getHitCount() << ")" << endl;
+    }
+}
+
+// The same spheres and quads added to a flat BVH scene as objects and to its primitive pool,
+// comparing the memory they take with the structure and the hits of the same rays
+static void benchmarkPool() {
+    const int primitiveCount = 1000000;
+    const int rayCount = 500000;
+
+    auto white = new ConstantTexture(Vector3f(1, 1, 1));
+    auto diffuse = new DiffuseMaterial(white, nullptr);
+    auto light = new EmissiveMaterial(4, white, nullptr);
+    vector<Vector3f> positions, edges;
+    for (int i = 0; i < primitiveCount; i++) {
+        positions.emplace_back(rand01(), rand01(), rand01());
+        edges.push_back(0.004f * randomUnitVector3d());
+    }
+    RayBatch batch;
+    batch.reserve(rayCount);
+    for (int i = 0; i < rayCount; i++) {
+        batch.add(Ray(Vector3f(rand01(), rand01(), rand01()), randomUnitVector3d()));
+    }
+
+    HitBatch results[2];
+    for (int pooled = 0; pooled < 2; pooled++) {
+        Scene scene;
+        scene.setCamera(new PerspectiveCamera(Vector3f(0.5f, 0.5f, -1.5f), Vector3f(0, 0, 1), Vector3f(0, 1, 0)));
+        scene.addObject(new Quad(Vector3f(0, 1.5f, 0), Vector3f(1, 0, 0), Vector3f(0, 0, 1), light));
+        scene.setFlat(true);
+        for (int i = 0; i < primitiveCount; i++) {
+            Vector3f b = Vector3f::cross(edges[i], Vector3f(0, 1, 0)).normalized() * 0.004f;
+            if (pooled && i % 2 == 0) {
+                scene.addSphere(positions[i], 0.002f, diffuse);
+            } else if (pooled) {
+                scene.addQuad(positions[i], edges[i], b, diffuse);
+            } else if (i % 2 == 0) {
+                scene.addObject(new Sphere(positions[i], 0.002f, diffuse));
+            } else {
+                scene.addObject(new Quad(positions[i], edges[i], b, diffuse));
+            }
+        }
+        auto start = chrono::steady_clock::now();
+        scene.buildScene();
+        double buildSeconds = secondsSince(start);
+
+        start = chrono::steady_clock::now();
+        scene.intersect(batch, results[pooled], 1);
+        double seconds = secondsSince(start);
+        cout << (pooled ? "Pooled:  " : "Objects: ") << buildSeconds * 1e3 << " ms build, "
+             << rayCount / seconds / 1e6 << " M rays/s (" << results[pooled].getHitCount() << " hits)" << endl;
+    }
+
+    // Besides the flat BVH, which copies both into its packets; objects also take a pointer
+    // in the group and the allocator's overhead
+    cout << "Sphere: " << sizeof(Sphere) + sizeof(Object3D*) << " bytes as an object, "
+         << sizeof(SpherePacket) / PacketWidth << " pooled" << endl;
+    cout << "Quad:   " << sizeof(Quad) + sizeof(Object3D*) << " bytes as an object, "
+         << sizeof(QuadPacket) / PacketWidth << " pooled" << endl;
+
+    int differences = 0;
+    for (int i = 0; i < rayCount; i++) {
+        const Hit &a = results[0].getHits()[i], &b = results[1].getHits()[i];
+        differences += results[0].getResults()[i] != results[1].getResults()[i] || a.getT() != b.getT()
+                       || (results[0].getResults()[i] && (a.getNormal() - b.getNormal()).length() > 1e-4f);
+    }
+    cout << differences << " of " << rayCount << " hits differ" << endl;
+}
+
+// Closest hits of all rays through one structure
+static void traceAccelerator(const char *name, double buildSeconds, size_t memory, const Object3D *structure,
+                             size_t objectCount, const vector<Ray> &rays) {
+    int hits = 0;
+    double distance = 0;
+    auto start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        Hit hit;
+        if (structure->intersect(ray, hit, 1e-4f)) {
+            hits++;
+            distance += hit.getT();
+        }
+    }
+    double seconds = secondsSince(start);
+    cout << name << buildSeconds * 1e3 << " ms build, " << (float) memory / objectCount << " bytes/object, "
+         << rays.size() / seconds / 1e6 << " M rays/s (" << hits << " hits, mean t " << distance / hits << ")"
+         << endl;
+}
+
+// Builds every structure a Scene can trace against over the same objects, so that the
+// best one for a workload can be picked with Scene::setAcceleratorType()
+static void compareAccelerators(const vector<Object3D*> &objects, const vector<Ray> &rays) {
+    auto start = chrono::steady_clock::now();
+    auto bvh = new BVHNode(objects);
+    double bvhSeconds = secondsSince(start);
+    traceAccelerator("BVHNode:        ", bvhSeconds, bvh->getNodeCount() * sizeof(BVHNode), bvh, objects.size(), rays);
+
+    // The flattened BVHs are built from a BVHNode tree, which their build time includes
+    start = chrono::steady_clock::now();
+    Accelerator *accelerator = new CompressedBVH(bvh);
+    traceAccelerator("Compressed BVH: ", bvhSeconds + secondsSince(start), accelerator->getMemoryUsage(), accelerator,
+                     objects.size(), rays);
+    delete accelerator;
+
+    start = chrono::steady_clock::now();
+    accelerator = new FlatBVH(bvh);
+    traceAccelerator("Flat BVH:       ", bvhSeconds + secondsSince(start), accelerator->getMemoryUsage(), accelerator,
+                     objects.size(), rays);
+    delete accelerator;
+    delete bvh;
+
+    start = chrono::steady_clock::now();
+    auto grid = new UniformGrid(objects);
+    cout << "Uniform grid " << grid->getResolution(0) << "x" << grid->getResolution(1) << "x" << grid->getResolution(2)
+         << ", " << (float) grid->getReferenceCount() / objects.size() << " references/object" << endl;
+    traceAccelerator("Uniform grid:   ", secondsSince(start), grid->getMemoryUsage(), grid, objects.size(), rays);
+    delete grid;
+
+    start = chrono::steady_clock::now();
+    auto kdTree = new KdTree(objects);
+    cout << "Kd-tree " << kdTree->getNodeCount() << " nodes, " << (float) kdTree->getReferenceCount() / objects.size()
+         << " references/object" << endl;
+    traceAccelerator("Kd-tree:        ", secondsSince(start), kdTree->getMemoryUsage(), kdTree, objects.size(), rays);
+    delete kdTree;
+}
+
+// Primary rays through every pixel of scene 1 to 4, or random rays through a dense volume
+// of small spheres for "particles"
+static void benchmarkAccelerators(const char *name) {
+    vector<Ray> rays;
+    if (strcmp(name, "particles") == 0) {
+        const int sphereCount = 100000;
+        const int rayCount = 200000;
+        vector<Object3D*> objects;
+        for (int i = 0; i < sphereCount; i++) {
+            objects.push_back(new Sphere(Vector3f(rand01(), rand01(), rand01()), 0.004f, nullptr));
+        }
+        for (int i = 0; i < rayCount; i++) {
+            Vector3f origin = Vector3f(0.5f, 0.5f, 0.5f) + 2 * randomUnitVector3d();
+            Vector3f target(rand01(), rand01(), rand01());
+            rays.emplace_back(origin, (target - origin).normalized());
+        }
+        compareAccelerators(objects, rays);
+        for (auto object : objects) {
+            delete object;
+        }
+        return;
+    }
+
+    Scene scene;
+    void (*scenes[])(Scene &) = {setScene01, setScene02, setScene03, setScene04};
+    int index = atoi(name) - 1;
+    if (index < 0 || index >= 4) {
+        cout << "Unknown scene " << name << endl;
+        return;
+    }
+    scenes[index](scene);
+    scene.buildScene();
+
+    Camera *camera = scene.getCamera();
+    for (int j = 0; j < camera->getHeight(); j++) {
+        for (int i = 0; i < camera->getWidth(); i++) {
+            rays.push_back(camera->generateRay(Vector2f(i + 0.5f, j + 0.5f)));
+        }
+    }
+    compareAccelerators(scene.getGroup()->getObjects(), rays);
+}
+
+// Parses the file on one thread and on all hardware threads
+static void benchmarkObj(const char *filename) {
+    int threadCounts[] = {1, 0};
+    for (int threads : threadCounts) {
+        ObjData data;
+        if (!loadObj(filename, data, threads)) {
+            return;
+        }
+        cout << (threads == 1 ? "1 thread:    " : "all threads: ") << data.bytes / data.seconds / 1e6 << " MB/s ("
+             << data.positions.size() << " v, " << data.texcoords.size() << " vt, " << data.normals.size()
+             << " vn, " << data.corners.size() / 3 << " triangles)" << endl;
+    }
+}
+
+// Startup time of a mesh without its cache (parsing, building the BVH and writing the
+// cache) and with it (mapping the cache)
+static void benchmarkMeshCache(const char *filename) {
+    remove((string(filename) + ".meshcache").c_str());
+    auto start = chrono::steady_clock::now();
+    Mesh *parsed = new Mesh(filename, nullptr);
+    double parseSeconds = secondsSince(start);
+    delete parsed;
+
+    start = chrono::steady_clock::now();
+    Mesh *mapped = new Mesh(filename, nullptr);
+    double mapSeconds = secondsSince(start);
+    cout << "Parse and build: " << parseSeconds * 1e3 << " ms" << endl;
+    cout << "Map cache:       " << mapSeconds * 1e3 << " ms (" << (mapped->isMapped() ? "mapped" : "not mapped")
+         << ")" << endl;
+    delete mapped;
+}
+
+// Random rays through the bounds of a mesh, before and after compacting it
+static void benchmarkCompact(const char *filename) {
+    const int rayCount = 200000;
+    Mesh mesh(filename, nullptr);
+    AABB box = mesh.getAABB();
+    Vector3f center = (box.getMin() + box.getMax()) / 2;
+    float radius = (box.getMax() - box.getMin()).length();
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f origin = center + radius * randomUnitVector3d();
+        Vector3f target = center + 0.25f * radius * randomUnitVector3d();
+        rays.emplace_back(origin, (target - origin).normalized());
+    }
+
+    int triangleCount = (int) mesh.t.size();
+    vector<float> distances(rayCount);
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            mesh.compact();
+        }
+        int hits = 0, differences = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < rayCount; i++) {
+            Hit hit;
+            if (mesh.intersect(rays[i], hit, 0)) {
+                hits++;
+            }
+            if (pass == 1 && fabs(hit.getT() - distances[i]) > 1e-3f * radius) {
+                differences++;
+            }
+            distances[i] = hit.getT();
+        }
+        double seconds = secondsSince(start);
+        cout << (pass == 0 ? "Full:    " : "Compact: ") << (double) mesh.getMemoryUsage() / triangleCount
+             << " bytes/triangle, " << rayCount / seconds / 1e6 << " M rays/s (" << hits << " hits";
+        if (pass == 1) cout << ", " << differences << " differ";
+        cout << ")" << endl;
+    }
+}
+
+// Passes of primary rays from cameras around a mesh, in memory and then paged with the
+// given residency budget
+static void benchmarkPaged(const char *filename, double budgetMegabytes) {
+    const int passCount = 6;
+    const int resolution = 256;
+    Mesh mesh(filename, nullptr);
+    AABB box = mesh.getAABB();
+    Vector3f center = (box.getMin() + box.getMax()) / 2;
+    float radius = (box.getMax() - box.getMin()).length() / 2;
+
+    vector<vector<Ray>> passes(passCount);
+    for (int pass = 0; pass < passCount; pass++) {
+        float angle = 2 * (float) M_PI * pass / passCount;
+        Vector3f eye = center + 2 * radius * Vector3f(cos(angle), 0.5f, sin(angle));
+        Vector3f forward = (center - eye).normalized();
+        Vector3f right = Vector3f::cross(forward, Vector3f(0, 1, 0)).normalized();
+        Vector3f up = Vector3f::cross(right, forward);
+        for (int y = 0; y < resolution; y++) {
+            for (int x = 0; x < resolution; x++) {
+                float px = (x + 0.5f) / resolution - 0.5f, py = (y + 0.5f) / resolution - 0.5f;
+                passes[pass].emplace_back(eye, (forward + px * right + py * up).normalized());
+            }
+        }
+    }
+
+    vector<vector<float>> distances(passCount);
+    for (int pass = 0; pass < passCount; pass++) {
+        auto start = chrono::steady_clock::now();
+        for (const Ray &ray : passes[pass]) {
+            Hit hit;
+            mesh.intersect(ray, hit, 0);
+            distances[pass].push_back(hit.getT());
+        }
+        cout << "In memory, pass " << pass << ": " << passes[pass].size() / secondsSince(start) / 1e6 << " M rays/s, "
+             << mesh.getMemoryUsage() / 1e6 << " MB" << endl;
+    }
+
+    if (!mesh.page((size_t) (budgetMegabytes * 1e6))) {
+        return;
+    }
+    for (int pass = 0; pass < passCount; pass++) {
+        mesh.resetPagingStatistics();
+        int differences = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < (int) passes[pass].size(); i++) {
+            Hit hit;
+            mesh.intersect(passes[pass][i], hit, 0);
+            differences += hit.getT() != distances[pass][i];
+        }
+        double seconds = secondsSince(start);
+        Mesh::PagingStatistics statistics = mesh.getPagingStatistics();
+        cout << "Paged, pass " << pass << ": " << passes[pass].size() / seconds / 1e6 << " M rays/s, "
+             << statistics.pageIns << " page-ins, " << statistics.evictions << " evictions, "
+             << statistics.residentBytes / 1e6 << " MB resident (" << differences << " differ)" << endl;
+    }
+}
+
+// Builds levels of detail of a mesh and traces the same random rays against each level
+static void benchmarkLOD(const char *filename) {
+    const int rayCount = 200000;
+    Mesh mesh(filename, nullptr);
+    auto start = chrono::steady_clock::now();
+    mesh.buildLODs(6);
+    cout << "Simplify: " << secondsSince(start) * 1e3 << " ms" << endl;
+
+    AABB box = mesh.getAABB();
+    Vector3f center = (box.getMin() + box.getMax()) / 2;
+    float radius = (box.getMax() - box.getMin()).length();
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f origin = center + radius * randomUnitVector3d();
+        Vector3f target = center + 0.25f * radius * randomUnitVector3d();
+        rays.emplace_back(origin, (target - origin).normalized());
+    }
+
+    vector<bool> fullHits(rayCount);
+    for (int level = 0; level < mesh.getLODCount(); level++) {
+        const Mesh *lod = mesh.getLOD(level);
+        int hits = 0, differences = 0;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < rayCount; i++) {
+            Hit hit;
+            bool isHit = lod->intersect(rays[i], hit, 0);
+            hits += isHit;
+            if (level == 0) fullHits[i] = isHit;
+            differences += isHit != fullHits[i];
+        }
+        double seconds = secondsSince(start);
+        cout << "Level " << level << ": " << lod->t.size() << " triangles, error "
+             << mesh.getLODError(level) / radius * 100 << "% of the diagonal, " << rayCount / seconds / 1e6
+             << " M rays/s (" << hits << " hits, " << differences << " differ from level 0)" << endl;
+    }
+}
+
+// Shadow rays between random points around a mesh, answered by a closest hit search and
+// by an any-hit query
+static void benchmarkOccluded(const char *filename) {
+    const int rayCount = 200000;
+    Mesh mesh(filename, nullptr);
+    AABB box = mesh.getAABB();
+    Vector3f center = (box.getMin() + box.getMax()) / 2;
+    float radius = (box.getMax() - box.getMin()).length();
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f origin = center + radius * randomUnitVector3d();
+        Vector3f target = center + radius * randomUnitVector3d();
+        rays.emplace_back(origin, target - origin);
+    }
+
+    int closestCount = 0, anyCount = 0;
+    auto start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        Hit hit;
+        closestCount += mesh.intersect(ray, hit, 1e-4f) && hit.getT() < 1;
+    }
+    double closestSeconds = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        anyCount += mesh.occluded(ray, 1e-4f, 1);
+    }
+    double anySeconds = secondsSince(start);
+    cout << "Closest hit: " << rayCount / closestSeconds / 1e6 << " M rays/s (" << closestCount << " occluded)" << endl;
+    cout << "Any hit:     " << rayCount / anySeconds / 1e6 << " M rays/s (" << anyCount << " occluded)" << endl;
+}
+
+// Rays against a rotated and scaled triangle, moved into object space and with the hit normal
+// moved back: through the inverted Matrix4f and Vector4f temporaries instances used to keep,
+// through Affine3f, and through Instance::intersect with computeHitSurface
+static void benchmarkInstance() {
+    const int rayCount = 1000000;
+    Triangle triangle(Vector3f(-1, -1, 0), Vector3f(1, -1, 0), Vector3f(0, 1, 0), nullptr);
+    Matrix4f m = Instance::composeMatrix(Vector3f(2, 1, 0.5f), Vector3f(0.3f, -0.2f, 5), 20, 35, 10);
+    Instance instance(&triangle, m);
+    Matrix4f inverse = m.inverse();
+    Affine3f toWorld(m), affine = toWorld.inverse();
+
+    vector<Ray> rays;
+    AABB box = instance.getAABB();
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f target = box.getMin() + Vector3f(rand01(), rand01(), rand01()) * (box.getMax() - box.getMin());
+        Vector3f origin = target - 10 * randomUnitVector3d();
+        rays.emplace_back(origin, target - origin);
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        int matrixHits = 0, affineHits = 0, instanceHits = 0;
+        float sum = 0;
+        auto start = chrono::steady_clock::now();
+        for (const Ray &ray : rays) {
+            Ray objectRay((inverse * Vector4f(ray.getOrigin(), 1)).xyz(), (inverse * Vector4f(ray.getDirection(), 0)).xyz());
+            Hit hit;
+            if (triangle.intersect(objectRay, hit, 0)) {
+                triangle.computeSurface(objectRay, hit);
+                sum += (inverse.transposed() * Vector4f(hit.getNormal(), 0)).xyz().normalized()[0];
+                matrixHits++;
+            }
+        }
+        double matrixSeconds = secondsSince(start);
+
+        start = chrono::steady_clock::now();
+        for (const Ray &ray : rays) {
+            Ray objectRay(affine.transformPoint(ray.getOrigin()), affine.transformVector(ray.getDirection()));
+            Hit hit;
+            if (triangle.intersect(objectRay, hit, 0)) {
+                triangle.computeSurface(objectRay, hit);
+                sum += toWorld.transformNormal(hit.getNormal()).normalized()[0];
+                affineHits++;
+            }
+        }
+        double affineSeconds = secondsSince(start);
+
+        start = chrono::steady_clock::now();
+        for (const Ray &ray : rays) {
+            Hit hit;
+            if (instance.intersect(ray, hit, 0)) {
+                computeHitSurface(ray, hit);
+                sum += hit.getNormal()[0];
+                instanceHits++;
+            }
+        }
+        double instanceSeconds = secondsSince(start);
+
+        // The first pass warms up the caches
+        if (pass == 0) continue;
+        cout << "Matrix4f: " << matrixSeconds / rayCount * 1e9 << " ns/ray (" << matrixHits << " hits)" << endl;
+        cout << "Affine3f: " << affineSeconds / rayCount * 1e9 << " ns/ray (" << affineHits << " hits)" << endl;
+        cout << "Instance: " << instanceSeconds / rayCount * 1e9 << " ns/ray (" << instanceHits << " hits, "
+             << sum << ")" << endl;
+    }
+}
+
+// Spheres in Transforms, of which a tenth move by a random step every frame, as animated
+// objects would. Each frame refits the BVHNode and rebuilds the subtrees whose SAH cost grew
+// past the threshold Scene uses, against a full build over the same objects.
+static void benchmarkRefit() {
+    const int objectCount = 100000;
+    const int frameCount = 20;
+    const float step = 0.01f;
+    const float threshold = 1.5f;
+
+    vector<Object3D*> objects;
+    vector<Transform*> transforms;
+    vector<Vector3f> positions;
+    for (int i = 0; i < objectCount; i++) {
+        positions.emplace_back(rand01(), rand01(), rand01());
+        transforms.push_back(new Transform(Matrix4f::translation(positions.back()),
+                                           new Sphere(Vector3f(0, 0, 0), 0.002f, nullptr)));
+        objects.push_back(transforms.back());
+    }
+
+    auto start = chrono::steady_clock::now();
+    unique_ptr<BVHNode> bvh(new BVHNode(objects));
+    double buildSeconds = secondsSince(start);
+    cout << "Full build: " << buildSeconds * 1e3 << " ms" << endl;
+
+    double refitTotal = 0, rebuildTotal = 0;
+    for (int frame = 0; frame < frameCount; frame++) {
+        for (int i = frame % 10; i < objectCount; i += 10) {
+            positions[i] += step * randomUnitVector3d();
+            transforms[i]->setMatrix(Matrix4f::translation(positions[i]));
+        }
+
+        start = chrono::steady_clock::now();
+        bvh->refit();
+        double refitSeconds = secondsSince(start);
+        start = chrono::steady_clock::now();
+        int rebuilt = bvh->rebuildDegraded(threshold);
+        double rebuildSeconds = secondsSince(start);
+        refitTotal += refitSeconds;
+        rebuildTotal += rebuildSeconds;
+        cout << "Frame " << frame << ": refit " << refitSeconds * 1e3 << " ms, rebuild " << rebuildSeconds * 1e3
+             << " ms (" << rebuilt << " subtrees), " << (refitSeconds + rebuildSeconds) / buildSeconds * 100
+             << "% of a full build" << endl;
+    }
+    cout << "Average: " << (refitTotal + rebuildTotal) / frameCount * 1e3 << " ms per frame, "
+         << (refitTotal + rebuildTotal) / frameCount / buildSeconds * 100 << "% of a full build" << endl;
+
+    start = chrono::steady_clock::now();
+    unique_ptr<BVHNode> fresh(new BVHNode(objects));
+    cout << "Full build after moving: " << secondsSince(start) * 1e3 << " ms, relative SAH cost "
+         << bvh->getRelativeCost() << " updated vs " << fresh->getRelativeCost() << " rebuilt" << endl;
+    bvh.reset();
+    fresh.reset();
+    for (auto object : objects) {
+        delete object;
+    }
+}
+
+// Six quads with outward normals around the box from min to max
+static vector<Object3D*> makeBoxFaces(const Vector3f &min, const Vector3f &max) {
+    Vector3f center = (min + max) / 2, size = max - min;
+    Vector3f dx(size.x(), 0, 0), dy(0, size.y(), 0), dz(0, 0, size.z());
+    return {new Quad(center + dz / 2, dx, dy, nullptr), new Quad(center - dz / 2, dy, dx, nullptr),
+            new Quad(center + dx / 2, dy, dz, nullptr), new Quad(center - dx / 2, dz, dy, nullptr),
+            new Quad(center + dy / 2, dz, dx, nullptr), new Quad(center - dy / 2, dx, dz, nullptr)};
+}
+
+// Where random rays crossing the bounds of a fog boundary enter and leave it: with the two
+// closest hit searches ConstantMedium used to make, and with one Object3D::getIntervals query.
+// Also counts the rays whose first interval differs from the two hits by more than 1e-3, and
+// those the query finds inside the boundary more than once.
+static void compareMediumBoundary(const char *name, const Object3D *boundary) {
+    const int rayCount = 200000;
+    AABB box = boundary->getAABB();
+    float diagonal = (box.getMax() - box.getMin()).length();
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; i++) {
+        Vector3f target = box.getMin() + Vector3f(rand01(), rand01(), rand01()) * (box.getMax() - box.getMin());
+        Vector3f direction = randomUnitVector3d();
+        rays.emplace_back(target - diagonal * direction, direction);
+    }
+
+    vector<Interval> intervals;
+    int hits = 0, differences = 0, multiple = 0;
+    for (const Ray &ray : rays) {
+        Hit enter, leave;
+        bool twoHits = boundary->intersect(ray, enter, 0) && boundary->intersect(ray, leave, enter.getT() + 1e-4f);
+        intervals.clear();
+        boundary->getIntervals(ray, 0, MAXFLOAT, intervals);
+        hits += twoHits;
+        multiple += intervals.size() > 1;
+        differences += twoHits != !intervals.empty()
+                       || (twoHits && (fabs(intervals[0].getMin() - enter.getT()) > 1e-3f
+                                       || fabs(intervals[0].getMax() - leave.getT()) > 1e-3f));
+    }
+
+    float sum = 0;
+    auto start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        Hit enter, leave;
+        if (boundary->intersect(ray, enter, 0) && boundary->intersect(ray, leave, enter.getT() + 1e-4f)) {
+            sum += leave.getT() - enter.getT();
+        }
+    }
+    double twoPassSeconds = secondsSince(start);
+    start = chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        intervals.clear();
+        boundary->getIntervals(ray, 0, MAXFLOAT, intervals);
+        if (!intervals.empty()) sum += intervals[0].getLength();
+    }
+    double intervalSeconds = secondsSince(start);
+    cout << name << ": two hits " << twoPassSeconds / rayCount * 1e9 << " ns/ray, intervals "
+         << intervalSeconds / rayCount * 1e9 << " ns/ray (" << hits << " hits, " << differences << " differ, "
+         << multiple << " with several intervals, " << sum << ")" << endl;
+}
+
+// Fog boundaries: a sphere, a box of quads as a Group, a BVHNode and a rotated Transform, and
+// the mesh in filename on its own and instanced
+static void benchmarkMedia(const char *filename) {
+    Sphere sphere(Vector3f(0, 0, 0), 1, nullptr);
+    compareMediumBoundary("Sphere   ", &sphere);
+
+    Group box;
+    for (Object3D *face : makeBoxFaces(Vector3f(-1, -2, -3), Vector3f(1, 2, 3))) {
+        box.addObject(face);
+    }
+    compareMediumBoundary("Box group", &box);
+    BVHNode boxBVH(makeBoxFaces(Vector3f(-1, -2, -3), Vector3f(1, 2, 3)));
+    compareMediumBoundary("Box BVH  ", &boxBVH);
+    Instance rotatedBox(&box, Vector3f(1, 1, 1), Vector3f(0.5f, 0, 0), 15, 30, 0);
+    compareMediumBoundary("Rotated  ", &rotatedBox);
+
+    Mesh mesh(filename, nullptr);
+    compareMediumBoundary("Mesh     ", &mesh);
+    Instance instance(&mesh, Vector3f(2, 2, 2), Vector3f(0, 1, 0), 0, 45, 0);
+    compareMediumBoundary("Instance ", &instance);
+
+    // Fraction of rays from the center of a unit sphere of fog with density 1 that scatter,
+    // 1 - exp(-1) for exponential distances
+    ConstantMedium fog(new Sphere(Vector3f(0, 0, 0), 1, nullptr), 1, Vector3f(1, 1, 1));
+    const int rayCount = 200000;
+    int scattered = 0;
+    for (int i = 0; i < rayCount; i++) {
+        Hit hit;
+        scattered += fog.intersect(Ray(Vector3f(0, 0, 0), randomUnitVector3d()), hit, 0);
+    }
+    cout << "Scattered from inside: " << (float) scattered / rayCount << " (expected " << 1 - exp(-1.0f) << ")"
+         << endl;
+}
+
+int main(int argc, char *argv[]) {
+    string name = argc > 1 ? argv[1] : "";
+    if (name == "triangles") {
+        benchmarkTriangles();
+    } else if (name == "boxes") {
+        benchmarkBoxes();
+    } else if (name == "flat") {
+        benchmarkFlat(3);
+        benchmarkFlat(1);
+    } else if (name == "obj" && argc > 2) {
+        benchmarkObj(argv[2]);
+    } else if (name == "meshcache" && argc > 2) {
+        benchmarkMeshCache(argv[2]);
+    } else if (name == "compact" && argc > 2) {
+        benchmarkCompact(argv[2]);
+    } else if (name == "paged" && argc > 3) {
+        benchmarkPaged(argv[2], atof(argv[3]));
+    } else if (name == "lod" && argc > 2) {
+        benchmarkLOD(argv[2]);
+    } else if (name == "media" && argc > 2) {
+        benchmarkMedia(argv[2]);
+    } else if (name == "occluded" && argc > 2) {
+        benchmarkOccluded(argv[2]);
+    } else if (name == "interleaved") {
+        benchmarkInterleaved();
+    } else if (name == "refit") {
+        benchmarkRefit();
+    } else if (name == "instance") {
+        benchmarkInstance();
+    } else if (name == "pool") {
+        benchmarkPool();
+    } else if (name == "batch") {
+        benchmarkBatch();
+    } else if (name == "layout") {
+        benchmarkLayouts();
+    } else if (name == "coherence") {
+        benchmarkCoherence();
+    } else if (name == "accelerators" && argc > 2) {
+        benchmarkAccelerators(argv[2]);
+    } else {
+        cout << "Usage: ./Benchmark <triangles | boxes | flat | interleaved | coherence | layout | batch | pool | instance | refit | obj file | meshcache file | compact file | paged file budgetMB | lod file | occluded file | media file"
+             << " | accelerators <1-4 | particles>>"
+             << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -2,89 +2,295 @@
 // Copied from PA1
 //
 #include "mesh.hpp"
-#include <fstream>
-#include <iostream>
+#include "obj_loader.hpp"
+#include "octahedral.hpp"
+#include <cstdio>
 #include <algorithm>
 #include <cstdlib>
 #include <utility>
-#include <sstream>
 
 bool Mesh::intersect(const Ray &r, Hit &h, float tmin) const {
+    if (paging != nullptr) {
+        return intersectPaged(r, h, tmin);
+    }
+    if (nodes.empty()) {
+        return false;
+    }
 
-    // Optional: Change this brute force method into a faster one.
-    bool result = false;
-    for (int triId = 0; triId < (int) t.size(); ++triId) {
-        TriangleIndex triIndex = t[triId];
-        Triangle triangle(v[triIndex[0]],
-                          v[triIndex[1]], v[triIndex[2]], material);
-        triangle.normal = n[triId];
-        result |= triangle.intersect(r, h, tmin);
+    const Vector3f &o = r.getOrigin();
+    const Vector3f &d = r.getDirection();
+    return traverse(nodes.data(), r, h, tmin, [&](const BVHNode &node) {
+        float tmax = h.getT(), u, v;
+        int lane;
+        if (compactData == nullptr) {
+            lane = intersectTrianglePacket(packets[node.offset], o, d, tmin, tmax, u, v);
+            if (lane >= 0) {
+                h.record(tmax, this, packetTriangles[node.offset * TrianglePacketWidth + lane], u, v);
+            }
+        } else {
+            TrianglePacket packet;
+            decodeLeaf(node, packet);
+            lane = intersectTrianglePacket(packet, o, d, tmin, tmax, u, v);
+            if (lane >= 0) {
+                h.record(tmax, this, node.offset + lane, u, v);
+            }
+        }
+        return lane >= 0;
+    });
+}
+
+void Mesh::computeSurface(const Ray &r, Hit &h) const {
+    int triId = h.getPrimitive();
+    h.setSurface(material, compactData == nullptr ? n[triId] : decodeOctahedral(compactData->normals[triId]));
+    if (!tUV.empty() || !tN.empty()) {
+        interpolate(triId, h.getB1(), h.getB2(), h);
     }
-    return result;
 }
 
-Mesh::Mesh(const char *filename, Material *material) : Object3D(material) {
+bool Mesh::occluded(const Ray &r, float tmin, float tmax) const {
+    if (paging != nullptr) {
+        return occludedPaged(r, tmin, tmax);
+    }
+    if (nodes.empty()) {
+        return false;
+    }
+
+    const Vector3f &o = r.getOrigin();
+    const Vector3f &d = r.getDirection();
+    Hit h(tmax, nullptr, Vector3f::ZERO);
+    return traverse(nodes.data(), r, h, tmin, [&](const BVHNode &node) {
+        float t = tmax, u, v;
+        if (compactData == nullptr) {
+            return intersectTrianglePacket(packets[node.offset], o, d, tmin, t, u, v) >= 0;
+        }
+        TrianglePacket packet;
+        decodeLeaf(node, packet);
+        return intersectTrianglePacket(packet, o, d, tmin, t, u, v) >= 0;
+    }, true);
+}
 
-    // Optional: Use tiny obj loader to replace this simple one.
-    std::ifstream f;
-    f.open(filename);
-    if (!f.is_open()) {
-        std::cout << "Cannot open " << filename << "\n";
+void Mesh::getCrossings(const Ray &r, std::vector<Crossing> &crossings) const {
+    if (paging != nullptr) {
+        getCrossingsPaged(r, crossings);
+        return;
+    }
+    if (nodes.empty()) {
         return;
     }
-    std::string line;
-    std::string vTok("v");
-    std::string fTok("f");
-    std::string texTok("vt");
-    char bslash = '/', space = ' ';
-    std::string tok;
-    int texID;
-    while (true) {
-        std::getline(f, line);
-        if (f.eof()) {
-            break;
+
+    const Vector3f &o = r.getOrigin();
+    const Vector3f &d = r.getDirection();
+    Hit h(MAXFLOAT, nullptr, Vector3f::ZERO);
+    traverse(nodes.data(), r, h, -MAXFLOAT, [&](const BVHNode &node) {
+        if (compactData == nullptr) {
+            addCrossings(packets[node.offset], node.count, o, d, crossings);
+        } else {
+            TrianglePacket packet;
+            decodeLeaf(node, packet);
+            addCrossings(packet, node.count, o, d, crossings);
         }
-        if (line.size() < 3) {
-            continue;
+        return false;
+    });
+}
+
+void Mesh::addCrossings(const TrianglePacket &packet, int count, const Vector3f &o, const Vector3f &d,
+                        std::vector<Crossing> &crossings) {
+    alignas(32) float ts[TrianglePacketWidth], us[TrianglePacketWidth], vs[TrianglePacketWidth];
+    int bits = intersectTrianglePacketLanes(packet, o, d, -MAXFLOAT, MAXFLOAT, ts, us, vs);
+    for (int lane = 0; lane < count; lane++) {
+        if (bits & (1 << lane)) {
+            crossings.push_back({ts[lane], isFrontFacing(packet, lane, d)});
         }
-        if (line.at(0) == '#') {
-            continue;
+    }
+}
+
+Mesh::Mesh(const char *filename, Material *material, bool useCache) : Object3D(material), sourcePath(filename) {
+    std::string cachePath = std::string(filename) + ".meshcache";
+    MappedFile source(filename);
+    if (useCache && source.isOpen() && loadCache(cachePath, source)) {
+        printf("Mapped %s: %d triangles\n", cachePath.c_str(), (int) t.size());
+        return;
+    }
+
+    ObjData data;
+    if (!loadObj(filename, data)) {
+        return;
+    }
+
+    int triangleCount = (int) data.corners.size() / 3;
+    bool hasUV = !data.texcoords.empty(), hasNormals = !data.normals.empty();
+    storage.v.swap(data.positions);
+    storage.uv.swap(data.texcoords);
+    storage.vn.swap(data.normals);
+    storage.t.resize(triangleCount);
+    if (hasUV) storage.tUV.resize(triangleCount);
+    if (hasNormals) storage.tN.resize(triangleCount);
+    for (int triId = 0; triId < triangleCount; ++triId) {
+        for (int ii = 0; ii < 3; ii++) {
+            const ObjData::Corner &corner = data.corners[3 * triId + ii];
+            storage.t[triId][ii] = corner.position;
+            if (hasUV) storage.tUV[triId][ii] = corner.texcoord;
+            if (hasNormals) storage.tN[triId][ii] = corner.normal;
         }
-        std::stringstream ss(line);
-        ss >> tok;
-        if (tok == vTok) {
-            Vector3f vec;
-            ss >> vec[0] >> vec[1] >> vec[2];
-            v.push_back(vec);
-        } else if (tok == fTok) {
-            if (line.find(bslash) != std::string::npos) {
-                std::replace(line.begin(), line.end(), bslash, space);
-                std::stringstream facess(line);
-                TriangleIndex trig;
-                facess >> tok;
-                for (int ii = 0; ii < 3; ii++) {
-                    facess >> trig[ii] >> texID;
-                    trig[ii]--;
-                }
-                t.push_back(trig);
+    }
+    if (storage.t.empty()) {
+        bindStorage();
+        return;
+    }
+
+    printf("Loaded %s: %d triangles, %.1f MB/s\n", filename, triangleCount,
+           data.bytes / std::max(data.seconds, 1e-9) / 1e6);
+    computeNormal();
+    computeAABB();
+    buildBVH();
+    bindStorage();
+    if (useCache) {
+        writeCache(cachePath, source);
+    }
+}
+
+// Spans into a mapped cache stay valid, since the mapping is shared
+Mesh::Mesh(const Mesh &other) : Object3D(other.material), v(other.v), t(other.t), n(other.n),
+        uv(other.uv), vn(other.vn), tUV(other.tUV), tN(other.tN), nodes(other.nodes), packets(other.packets),
+        packetTriangles(other.packetTriangles), storage(other.storage),
+        cache(other.cache), compactData(other.compactData), sourcePath(other.sourcePath), lods(other.lods),
+        lodErrors(other.lodErrors), paging(other.paging),
+        aabb(other.aabb) {
+    if (cache == nullptr) {
+        bindStorage();
+    }
+}
+
+Mesh &Mesh::operator=(const Mesh &other) {
+    if (this == &other) {
+        return *this;
+    }
+    Object3D::operator=(other);
+    v = other.v;
+    t = other.t;
+    n = other.n;
+    uv = other.uv;
+    vn = other.vn;
+    tUV = other.tUV;
+    tN = other.tN;
+    nodes = other.nodes;
+    packets = other.packets;
+    packetTriangles = other.packetTriangles;
+    storage = other.storage;
+    cache = other.cache;
+    compactData = other.compactData;
+    sourcePath = other.sourcePath;
+    lods = other.lods;
+    lodErrors = other.lodErrors;
+    paging = other.paging;
+    aabb = other.aabb;
+    if (cache == nullptr) {
+        bindStorage();
+    }
+    return *this;
+}
+
+Object3D *Mesh::transformed(const Matrix4f &m) const {
+    if (paging != nullptr) {
+        return nullptr;
+    }
+    auto mesh = new Mesh(*this);
+    mesh->copyToStorage();
+    mesh->expandCompact();
+    for (auto &vertex : mesh->storage.v) {
+        vertex = (m * Vector4f(vertex, 1)).xyz();
+    }
+    Affine3f normalTransform(m);
+    for (auto &normal : mesh->storage.vn) {
+        normal = normalTransform.transformNormal(normal).normalized();
+    }
+    mesh->computeNormal();
+    mesh->computeAABB();
+    mesh->buildBVH();
+    mesh->bindStorage();
+    if (isCompact()) {
+        mesh->compact();
+    }
+    return mesh;
+}
+
+void Mesh::bindStorage() {
+    v = storage.v;
+    t = storage.t;
+    n = storage.n;
+    uv = storage.uv;
+    vn = storage.vn;
+    tUV = storage.tUV;
+    tN = storage.tN;
+    nodes = storage.nodes;
+    packets = storage.packets;
+    packetTriangles = storage.packetTriangles;
+}
+
+void Mesh::copyToStorage() {
+    if (cache == nullptr) {
+        return;
+    }
+    storage.v.assign(v.begin(), v.end());
+    storage.t.assign(t.begin(), t.end());
+    storage.n.assign(n.begin(), n.end());
+    storage.uv.assign(uv.begin(), uv.end());
+    storage.vn.assign(vn.begin(), vn.end());
+    storage.tUV.assign(tUV.begin(), tUV.end());
+    storage.tN.assign(tN.begin(), tN.end());
+    storage.nodes.assign(nodes.begin(), nodes.end());
+    storage.packets.assign(packets.begin(), packets.end());
+    storage.packetTriangles.assign(packetTriangles.begin(), packetTriangles.end());
+    cache.reset();
+    bindStorage();
+}
+
+// Texture coordinates and smooth shading normal at barycentric coordinates (b1, b2)
+void Mesh::interpolate(int triId, float b1, float b2, Hit &h) const {
+    float b0 = 1 - b1 - b2;
+    if (!tUV.empty()) {
+        const TriangleIndex &index = tUV[triId];
+        if (index.x[0] >= 0 && index.x[1] >= 0 && index.x[2] >= 0) {
+            Vector2f coord = b0 * uv[index.x[0]] + b1 * uv[index.x[1]] + b2 * uv[index.x[2]];
+            h.setUV(coord[0], coord[1]);
+        }
+    }
+    if (!tN.empty()) {
+        const TriangleIndex &index = tN[triId];
+        if (index.x[0] >= 0 && index.x[1] >= 0 && index.x[2] >= 0) {
+            Vector3f normal;
+            if (compactData == nullptr) {
+                normal = b0 * vn[index.x[0]] + b1 * vn[index.x[1]] + b2 * vn[index.x[2]];
             } else {
-                TriangleIndex trig;
-                for (int ii = 0; ii < 3; ii++) {
-                    ss >> trig[ii];
-                    trig[ii]--;
-                }
-                t.push_back(trig);
+                const std::vector<uint32_t> &packed = compactData->vertexNormals;
+                normal = b0 * decodeOctahedral(packed[index.x[0]]) + b1 * decodeOctahedral(packed[index.x[1]])
+                         + b2 * decodeOctahedral(packed[index.x[2]]);
+            }
+            if (normal.squaredLength() > 0) {
+                h.setNormal(normal.normalized());
             }
-        } else if (tok == texTok) {
-            Vector2f texcoord;
-            ss >> texcoord[0];
-            ss >> texcoord[1];
         }
     }
-    computeNormal();
+}
 
-    f.close();
+size_t Mesh::getMemoryUsage() const {
+    size_t bytes = v.size() * sizeof(Vector3f) + t.size() * sizeof(TriangleIndex) + n.size() * sizeof(Vector3f)
+                   + uv.size() * sizeof(Vector2f) + vn.size() * sizeof(Vector3f)
+                   + (tUV.size() + tN.size()) * sizeof(TriangleIndex) + nodes.size() * sizeof(BVHNode)
+                   + packets.size() * sizeof(TrianglePacket) + packetTriangles.size() * sizeof(int);
+    if (compactData != nullptr) {
+        bytes += compactData->vertices.size() * sizeof(uint16_t) + compactData->indices16.size() * sizeof(uint16_t)
+                 + compactData->indices32.size() * sizeof(uint32_t) + compactData->normals.size() * sizeof(uint32_t)
+                 + compactData->vertexNormals.size() * sizeof(uint32_t);
+    }
+    if (paging != nullptr) {
+        bytes += getPagingStatistics().residentBytes;
+    }
+    return bytes;
+}
 
+void Mesh::computeAABB() {
+    const std::vector<Vector3f> &v = storage.v;
     aabb = AABB(v[0], v[1]);
     for (int i = 2; i < (int) v.size(); i++) {
         aabb.expand(v[i]);
@@ -92,12 +298,150 @@ Mesh::Mesh(const char *filename, Material *material) : Object3D(material) {
 }
 
 void Mesh::computeNormal() {
-    n.resize(t.size());
-    for (int triId = 0; triId < (int) t.size(); ++triId) {
-        TriangleIndex& triIndex = t[triId];
+    const std::vector<Vector3f> &v = storage.v;
+    std::vector<Vector3f> &n = storage.n;
+    n.resize(storage.t.size());
+    for (int triId = 0; triId < (int) storage.t.size(); ++triId) {
+        const TriangleIndex &triIndex = storage.t[triId];
         Vector3f a = v[triIndex[1]] - v[triIndex[0]];
         Vector3f b = v[triIndex[2]] - v[triIndex[0]];
         b = Vector3f::cross(a, b);
         n[triId] = b / b.length();
     }
 }
+
+void Mesh::buildBVH() {
+    const std::vector<Vector3f> &v = storage.v;
+    const std::vector<TriangleIndex> &t = storage.t;
+    std::vector<BVHNode> &nodes = storage.nodes;
+    std::vector<TrianglePacket> &packets = storage.packets;
+    nodes.clear();
+    packets.clear();
+    storage.packetTriangles.clear();
+    if (t.empty()) {
+        return;
+    }
+
+    std::vector<int> ids(t.size());
+    std::vector<AABB> boxes(t.size());
+    std::vector<Vector3f> centroids(t.size());
+    for (int triId = 0; triId < (int) t.size(); ++triId) {
+        const TriangleIndex &triIndex = t[triId];
+        ids[triId] = triId;
+        boxes[triId] = AABB(v[triIndex.x[0]], v[triIndex.x[1]]);
+        boxes[triId].expand(v[triIndex.x[2]]);
+        centroids[triId] = (v[triIndex.x[0]] + v[triIndex.x[1]] + v[triIndex.x[2]]) / 3;
+    }
+
+    // Triangle of every packet lane, -1 for padding
+    std::vector<int> leafTriangles;
+    nodes.reserve(2 * t.size());
+    buildNode(ids, boxes, centroids, leafTriangles, 0, (int) ids.size(), 0);
+
+    storage.packetTriangles.swap(leafTriangles);
+    for (const BVHNode &node : nodes) {
+        if (node.count == 0) continue;
+        for (int lane = 0; lane < node.count; lane++) {
+            int triId = storage.packetTriangles[node.offset * TrianglePacketWidth + lane];
+            const TriangleIndex &triIndex = t[triId];
+            packets[node.offset].set(lane, v[triIndex.x[0]], v[triIndex.x[1]], v[triIndex.x[2]]);
+        }
+    }
+}
+
+// Binned SAH build over ids[begin, end). Returns the index of the new node.
+int Mesh::buildNode(std::vector<int> &ids, std::vector<AABB> &boxes, std::vector<Vector3f> &centroids,
+                    std::vector<int> &leafTriangles, int begin, int end, int depth) {
+    std::vector<BVHNode> &nodes = storage.nodes;
+    std::vector<TrianglePacket> &packets = storage.packets;
+    int index = (int) nodes.size();
+    nodes.emplace_back();
+
+    AABB bounds, centroidBounds;
+    for (int i = begin; i < end; i++) {
+        bounds.expand(boxes[ids[i]]);
+        centroidBounds.expand(centroids[ids[i]]);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        nodes[index].min[axis] = bounds.getAxis(axis).getMin();
+        nodes[index].max[axis] = bounds.getAxis(axis).getMax();
+    }
+
+    int count = end - begin;
+    int axis = centroidBounds.getLongestAxis();
+    float axisMin = centroidBounds.getAxis(axis).getMin();
+    float axisLength = centroidBounds.getAxis(axis).getLength();
+    if (count <= MaxLeafSize || axisLength <= 0) {
+        if (count > MaxLeafSize) {
+            // Coincident centroids, split them anyway so that every leaf fits into a packet
+            int mid = begin + count / 2;
+            buildNode(ids, boxes, centroids, leafTriangles, begin, mid, depth + 1);
+            nodes[index].offset = buildNode(ids, boxes, centroids, leafTriangles, mid, end, depth + 1);
+            nodes[index].count = 0;
+            return index;
+        }
+        nodes[index].offset = (int) packets.size();
+        nodes[index].count = count;
+        packets.emplace_back();
+        leafTriangles.insert(leafTriangles.end(), ids.begin() + begin, ids.begin() + end);
+        leafTriangles.resize(packets.size() * TrianglePacketWidth, -1);
+        return index;
+    }
+
+    auto binOf = [&](int id) {
+        int bin = (int) (BinCount * (centroids[id][axis] - axisMin) / axisLength);
+        return std::min(bin, BinCount - 1);
+    };
+
+    AABB binBoxes[BinCount];
+    int binCounts[BinCount] = {0};
+    for (int i = begin; i < end; i++) {
+        int bin = binOf(ids[i]);
+        binBoxes[bin].expand(boxes[ids[i]]);
+        binCounts[bin]++;
+    }
+
+    // Sweep from the right to get the cost of every right side, then from the left
+    float rightCosts[BinCount];
+    AABB rightBox;
+    int rightCount = 0;
+    for (int i = BinCount - 1; i > 0; i--) {
+        rightBox.expand(binBoxes[i]);
+        rightCount += binCounts[i];
+        rightCosts[i] = rightCount * rightBox.getSurfaceArea();
+    }
+
+    int bestSplit = -1;
+    float bestCost = MAXFLOAT;
+    AABB leftBox;
+    int leftCount = 0;
+    for (int i = 1; i < BinCount && depth < MaxSAHDepth; i++) {
+        leftBox.expand(binBoxes[i - 1]);
+        leftCount += binCounts[i - 1];
+        if (leftCount == 0 || leftCount == count) continue;
+        float cost = leftCount * leftBox.getSurfaceArea() + rightCosts[i];
+        if (cost < bestCost) {
+            bestCost = cost;
+            bestSplit = i;
+        }
+    }
+
+    int mid;
+    if (bestSplit < 0) {
+        // All centroids fell into one bin or the tree got too deep, fall back to a median split
+        mid = begin + count / 2;
+        std::nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end, [&](int a, int b) {
+            return centroids[a][axis] < centroids[b][axis];
+        });
+    } else {
+        mid = (int) (std::partition(ids.begin() + begin, ids.begin() + end, [&](int id) {
+            return binOf(id) < bestSplit;
+        }) - ids.begin());
+    }
+
+    buildNode(ids, boxes, centroids, leafTriangles, begin, mid, depth + 1);
+    int right = buildNode(ids, boxes, centroids, leafTriangles, mid, end, depth + 1);
+    nodes[index].offset = right;
+    nodes[index].count = 0;
+    return index;
+}
@@ -0,0 +1,157 @@
+//
+// Implemented independently
+//
+// Binary cache of a parsed Mesh together with its BVH. The file is a header followed by
+// the arrays of the mesh, each aligned to 64 bytes, so that they can be used in place
+// from a read-only mapping. A cache belongs to the OBJ file of the same size and
+// modification time; if only the time differs, the contents are compared by hash, and
+// the new time is recorded in the cache when they match.
+//
+#include "mesh.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char CacheMagic[8] = {'R', 'T', 'M', 'E', 'S', 'H', '\0', '\0'};
+const uint32_t CacheVersion = 2;
+const uint64_t CacheAlignment = 64;
+
+enum CacheArray {
+    Vertices, Triangles, FaceNormals, Texcoords, VertexNormals, TexcoordIndices, NormalIndices,
+    Nodes, Packets, PacketTriangles, CacheArrayCount
+};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t packetWidth;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    uint64_t offsets[CacheArrayCount];
+    uint64_t counts[CacheArrayCount];
+    uint32_t elementSizes[CacheArrayCount];     // rejects caches written with another struct layout
+    float min[3], max[3];
+};
+
+struct CacheSection {
+    const void *data;
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+template <typename T>
+bool mapSection(const MappedFile &file, const CacheHeader &header, CacheArray array, ArraySpan<T> &span) {
+    uint64_t offset = header.offsets[array], count = header.counts[array];
+    if (header.elementSizes[array] != sizeof(T) || offset % CacheAlignment != 0 || offset > file.getSize()
+        || count > (file.getSize() - offset) / sizeof(T)) {
+        return false;
+    }
+    span = ArraySpan<T>((const T *) (file.getData() + offset), count);
+    return true;
+}
+
+// Places the array after the previous ones and records it in the header
+template <typename T>
+CacheSection addSection(CacheHeader &header, CacheArray array, const ArraySpan<T> &span, uint64_t &offset) {
+    offset = (offset + CacheAlignment - 1) / CacheAlignment * CacheAlignment;
+    header.offsets[array] = offset;
+    header.counts[array] = span.size();
+    header.elementSizes[array] = sizeof(T);
+    CacheSection section = {span.data(), offset, span.size() * sizeof(T)};
+    offset += section.bytes;
+    return section;
+}
+
+}
+
+bool Mesh::loadCache(const std::string &path, const MappedFile &source) {
+    auto file = std::make_shared<MappedFile>(path.c_str());
+    if (!file->isOpen() || file->getSize() < sizeof(CacheHeader)) {
+        return false;
+    }
+
+    CacheHeader header;
+    memcpy(&header, file->getData(), sizeof(header));
+    if (memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion
+        || header.packetWidth != TrianglePacketWidth || header.sourceSize != source.getSize()) {
+        return false;
+    }
+    bool touched = header.sourceTime != source.getModificationTime();
+    if (touched && header.sourceHash != source.getContentHash()) {
+        return false;
+    }
+
+    bool valid = mapSection(*file, header, Vertices, v) && mapSection(*file, header, Triangles, t)
+                 && mapSection(*file, header, FaceNormals, n) && mapSection(*file, header, Texcoords, uv)
+                 && mapSection(*file, header, VertexNormals, vn)
+                 && mapSection(*file, header, TexcoordIndices, tUV) && mapSection(*file, header, NormalIndices, tN)
+                 && mapSection(*file, header, Nodes, nodes) && mapSection(*file, header, Packets, packets)
+                 && mapSection(*file, header, PacketTriangles, packetTriangles);
+    if (!valid) {
+        bindStorage();
+        return false;
+    }
+
+    aabb = AABB(Vector3f(header.min[0], header.min[1], header.min[2]),
+                Vector3f(header.max[0], header.max[1], header.max[2]));
+    cache = file;
+    // Same contents with a new time, e.g. after a checkout: the next run need not hash again
+    if (touched) {
+        int64_t time = source.getModificationTime();
+        MappedFile::patch(path.c_str(), offsetof(CacheHeader, sourceTime), &time, sizeof(time));
+    }
+    return true;
+}
+
+void Mesh::writeCache(const std::string &path, const MappedFile &source) const {
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = CacheVersion;
+    header.packetWidth = TrianglePacketWidth;
+    header.sourceSize = source.getSize();
+    header.sourceTime = source.getModificationTime();
+    header.sourceHash = source.getContentHash();
+    for (int axis = 0; axis < 3; axis++) {
+        header.min[axis] = aabb.getAxis(axis).getMin();
+        header.max[axis] = aabb.getAxis(axis).getMax();
+    }
+
+    uint64_t offset = sizeof(header);
+    CacheSection sections[] = {
+            addSection(header, Vertices, v, offset),
+            addSection(header, Triangles, t, offset),
+            addSection(header, FaceNormals, n, offset),
+            addSection(header, Texcoords, uv, offset),
+            addSection(header, VertexNormals, vn, offset),
+            addSection(header, TexcoordIndices, tUV, offset),
+            addSection(header, NormalIndices, tN, offset),
+            addSection(header, Nodes, nodes, offset),
+            addSection(header, Packets, packets, offset),
+            addSection(header, PacketTriangles, packetTriangles, offset),
+    };
+
+    // Written under a temporary name, so that a reader never maps a partial file
+    std::string temporaryPath = path + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr) {
+        printf("Cannot write %s\n", path.c_str());
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t position = sizeof(header);
+    const char padding[CacheAlignment] = {0};
+    for (const CacheSection &section : sections) {
+        written = written && fwrite(padding, 1, section.offset - position, file) == section.offset - position;
+        written = written && (section.bytes == 0 || fwrite(section.data, section.bytes, 1, file) == 1);
+        position = section.offset + section.bytes;
+    }
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        printf("Cannot write %s\n", path.c_str());
+        remove(temporaryPath.c_str());
+    }
+}
@@ -0,0 +1,173 @@
+//
+// Implemented independently
+//
+// Compact representation of Mesh, see Mesh::compact().
+//
+#include "mesh.hpp"
+#include "octahedral.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// Moves the lower 10 bits of x to every third bit
+uint32_t spreadBits(uint32_t x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// Morton code of the upper 10 bits of a quantized position
+uint32_t mortonCode(const uint16_t *q) {
+    return spreadBits(q[0] >> 6) | (spreadBits(q[1] >> 6) << 1) | (spreadBits(q[2] >> 6) << 2);
+}
+
+template <typename T>
+void release(std::vector<T> &vector) {
+    std::vector<T>().swap(vector);
+}
+
+}
+
+void Mesh::compact() {
+    if (compactData != nullptr) {
+        return;
+    }
+    copyToStorage();
+    if (storage.t.empty()) {
+        return;
+    }
+
+    auto data = std::make_shared<Compact>();
+    const int vertexCount = (int) storage.v.size();
+    std::vector<uint16_t> quantized(3 * vertexCount);
+    for (int axis = 0; axis < 3; axis++) {
+        data->origin[axis] = aabb.getAxis(axis).getMin();
+        data->scale[axis] = aabb.getAxis(axis).getLength() / 65535.0f;
+        for (int i = 0; i < vertexCount; i++) {
+            long q = data->scale[axis] > 0 ? std::lround((storage.v[i][axis] - data->origin[axis]) / data->scale[axis]) : 0;
+            quantized[3 * i + axis] = (uint16_t) std::max(0L, std::min(65535L, q));
+        }
+    }
+
+    // Vertices along the Morton curve, so that the corners of nearby triangles share cache lines
+    std::vector<int> order(vertexCount), newIndex(vertexCount);
+    std::vector<uint32_t> codes(vertexCount);
+    for (int i = 0; i < vertexCount; i++) {
+        codes[i] = mortonCode(&quantized[3 * i]);
+    }
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&codes](int a, int b) {
+        return codes[a] < codes[b];
+    });
+    data->vertices.resize(3 * vertexCount);
+    for (int i = 0; i < vertexCount; i++) {
+        newIndex[order[i]] = i;
+        std::copy(&quantized[3 * order[i]], &quantized[3 * order[i]] + 3, &data->vertices[3 * i]);
+    }
+
+    // The BVH is built over the decoded positions, so that its bounds contain what traversal tests
+    for (int i = 0; i < vertexCount; i++) {
+        storage.v[i] = data->getVertex(i);
+    }
+    for (TriangleIndex &triIndex : storage.t) {
+        for (int ii = 0; ii < 3; ii++) {
+            triIndex[ii] = newIndex[triIndex[ii]];
+        }
+    }
+    computeNormal();
+    computeAABB();
+    buildBVH();
+
+    // Triangles in the order of the leaves, which then address a contiguous range
+    std::vector<int> triangleOrder;
+    triangleOrder.reserve(storage.t.size());
+    for (BVHNode &node : storage.nodes) {
+        if (node.count == 0) continue;
+        int first = (int) triangleOrder.size();
+        for (int lane = 0; lane < node.count; lane++) {
+            triangleOrder.push_back(storage.packetTriangles[node.offset * TrianglePacketWidth + lane]);
+        }
+        node.offset = first;
+    }
+
+    const int triangleCount = (int) triangleOrder.size();
+    if (vertexCount <= 65536) {
+        data->indices16.resize(3 * triangleCount);
+    } else {
+        data->indices32.resize(3 * triangleCount);
+    }
+    data->normals.resize(triangleCount);
+    std::vector<TriangleIndex> tUV(storage.tUV.empty() ? 0 : triangleCount);
+    std::vector<TriangleIndex> tN(storage.tN.empty() ? 0 : triangleCount);
+    for (int i = 0; i < triangleCount; i++) {
+        int triId = triangleOrder[i];
+        for (int ii = 0; ii < 3; ii++) {
+            if (data->indices16.empty()) {
+                data->indices32[3 * i + ii] = (uint32_t) storage.t[triId][ii];
+            } else {
+                data->indices16[3 * i + ii] = (uint16_t) storage.t[triId][ii];
+            }
+        }
+        data->normals[i] = encodeOctahedral(storage.n[triId]);
+        if (!tUV.empty()) tUV[i] = storage.tUV[triId];
+        if (!tN.empty()) tN[i] = storage.tN[triId];
+    }
+    storage.tUV.swap(tUV);
+    storage.tN.swap(tN);
+
+    data->vertexNormals.resize(storage.vn.size());
+    for (int i = 0; i < (int) storage.vn.size(); i++) {
+        data->vertexNormals[i] = encodeOctahedral(storage.vn[i]);
+    }
+
+    release(storage.v);
+    release(storage.t);
+    release(storage.n);
+    release(storage.vn);
+    release(storage.packets);
+    release(storage.packetTriangles);
+    compactData = data;
+    bindStorage();
+}
+
+// The BVH has to be rebuilt afterwards
+void Mesh::expandCompact() {
+    if (compactData == nullptr) {
+        return;
+    }
+    const Compact &data = *compactData;
+    int vertexCount = (int) data.vertices.size() / 3;
+    int triangleCount = (int) data.normals.size();
+    storage.v.resize(vertexCount);
+    for (int i = 0; i < vertexCount; i++) {
+        storage.v[i] = data.getVertex(i);
+    }
+    storage.t.resize(triangleCount);
+    storage.n.resize(triangleCount);
+    for (int triId = 0; triId < triangleCount; triId++) {
+        for (int ii = 0; ii < 3; ii++) {
+            storage.t[triId][ii] = data.getIndex(triId, ii);
+        }
+        storage.n[triId] = decodeOctahedral(data.normals[triId]);
+    }
+    storage.vn.resize(data.vertexNormals.size());
+    for (int i = 0; i < (int) data.vertexNormals.size(); i++) {
+        storage.vn[i] = decodeOctahedral(data.vertexNormals[i]);
+    }
+    compactData.reset();
+    bindStorage();
+}
+
+void Mesh::decodeLeaf(const BVHNode &node, TrianglePacket &packet) const {
+    const Compact &data = *compactData;
+    for (int lane = 0; lane < node.count; lane++) {
+        int triId = node.offset + lane;
+        packet.set(lane, data.getVertex(data.getIndex(triId, 0)), data.getVertex(data.getIndex(triId, 1)),
+                   data.getVertex(data.getIndex(triId, 2)));
+    }
+}
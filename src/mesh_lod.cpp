@@ -0,0 +1,422 @@
+//
+// Implemented independently
+//
+// Levels of detail of Mesh, see Mesh::buildLODs(). The levels are produced by one
+// progressive run of quadric error metric edge collapses (Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics", 1997).
+//
+#include "mesh.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix
+// [xx xy xz xw; yy yz yw; zz zw; ww]
+struct Quadric {
+    double q[10];
+
+    Quadric() {
+        std::fill(q, q + 10, 0.0);
+    }
+
+    // Plane n . p + d = 0 with a unit normal
+    Quadric(const Vector3f &n, double d, double weight) {
+        double a = n[0], b = n[1], c = n[2];
+        double values[10] = {a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d};
+        for (int i = 0; i < 10; i++) {
+            q[i] = values[i] * weight;
+        }
+    }
+
+    Quadric operator+(const Quadric &other) const {
+        Quadric result;
+        for (int i = 0; i < 10; i++) {
+            result.q[i] = q[i] + other.q[i];
+        }
+        return result;
+    }
+
+    double evaluate(const Vector3f &p) const {
+        double x = p[0], y = p[1], z = p[2];
+        return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+               + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+               + q[7] * z * z + 2 * q[8] * z + q[9];
+    }
+
+    // Point of minimal error, if the 3x3 system is well conditioned
+    bool minimize(Vector3f &p) const {
+        double a = q[0], b = q[1], c = q[2], e = q[4], f = q[5], i = q[7];
+        double det = a * (e * i - f * f) - b * (b * i - f * c) + c * (b * f - e * c);
+        if (std::fabs(det) < 1e-12) {
+            return false;
+        }
+        double rx = -q[3], ry = -q[6], rz = -q[8];
+        double x = (rx * (e * i - f * f) - b * (ry * i - f * rz) + c * (ry * f - e * rz)) / det;
+        double y = (a * (ry * i - f * rz) - rx * (b * i - f * c) + c * (b * rz - ry * c)) / det;
+        double z = (a * (e * rz - ry * f) - b * (b * rz - ry * c) + rx * (b * f - e * c)) / det;
+        p = Vector3f((float) x, (float) y, (float) z);
+        return true;
+    }
+};
+
+struct Collapse {
+    double cost;
+    int a, b;               // b is merged into a
+    int versionA, versionB; // the collapse is stale once either vertex changed
+    Vector3f position;
+
+    bool operator<(const Collapse &other) const {
+        return cost > other.cost;
+    }
+};
+
+class Simplifier {
+public:
+    Simplifier(const ArraySpan<Vector3f> &vertices, const ArraySpan<Mesh::TriangleIndex> &triangles, const AABB &bounds)
+            : positions(vertices.begin(), vertices.end()), faces(triangles.begin(), triangles.end()),
+              bounds(bounds), quadrics(vertices.size()), vertexFaces(vertices.size()),
+              versions(vertices.size(), 0), faceAlive(triangles.size(), 1), aliveFaces((int) triangles.size()) {
+        std::unordered_map<uint64_t, int> edgeFaces;
+        for (int f = 0; f < (int) faces.size(); f++) {
+            Vector3f normal;
+            double d;
+            if (plane(f, normal, d)) {
+                Quadric quadric(normal, d, 1);
+                for (int k = 0; k < 3; k++) {
+                    quadrics[faces[f][k]] = quadrics[faces[f][k]] + quadric;
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                vertexFaces[faces[f][k]].push_back(f);
+                edgeFaces[edgeKey(faces[f][k], faces[f][(k + 1) % 3])]++;
+            }
+        }
+
+        // Planes through boundary edges, perpendicular to their face, keep open borders in place
+        for (int f = 0; f < (int) faces.size(); f++) {
+            Vector3f normal;
+            double d;
+            if (!plane(f, normal, d)) continue;
+            for (int k = 0; k < 3; k++) {
+                int a = faces[f][k], b = faces[f][(k + 1) % 3];
+                if (edgeFaces[edgeKey(a, b)] != 1) continue;
+                Vector3f side = Vector3f::cross(positions[b] - positions[a], normal);
+                if (side.length() == 0) continue;
+                side.normalize();
+                Quadric quadric(side, -Vector3f::dot(side, positions[a]), BoundaryWeight);
+                quadrics[a] = quadrics[a] + quadric;
+                quadrics[b] = quadrics[b] + quadric;
+            }
+        }
+
+        for (const auto &entry : edgeFaces) {
+            push((int) (entry.first >> 32), (int) (entry.first & 0xffffffffu));
+        }
+    }
+
+    // Collapses edges until at most target triangles remain or no collapse is possible
+    void simplify(int target) {
+        while (aliveFaces > target && !heap.empty()) {
+            Collapse collapse = heap.top();
+            heap.pop();
+            if (versions[collapse.a] != collapse.versionA || versions[collapse.b] != collapse.versionB) {
+                continue;
+            }
+            if (flips(collapse)) {
+                continue;
+            }
+            apply(collapse);
+        }
+    }
+
+    void extract(std::vector<Vector3f> &vertices, std::vector<Mesh::TriangleIndex> &triangles) const {
+        std::vector<int> remap(positions.size(), -1);
+        vertices.clear();
+        triangles.clear();
+        for (int f = 0; f < (int) faces.size(); f++) {
+            if (!faceAlive[f]) continue;
+            Mesh::TriangleIndex triangle;
+            for (int k = 0; k < 3; k++) {
+                int vertex = faces[f][k];
+                if (remap[vertex] < 0) {
+                    remap[vertex] = (int) vertices.size();
+                    vertices.push_back(positions[vertex]);
+                }
+                triangle[k] = remap[vertex];
+            }
+            triangles.push_back(triangle);
+        }
+    }
+
+private:
+    static constexpr double BoundaryWeight = 100.0;
+
+    std::vector<Vector3f> positions;
+    std::vector<Mesh::TriangleIndex> faces;
+    AABB bounds;
+    std::vector<Quadric> quadrics;
+    std::vector<std::vector<int>> vertexFaces;
+    std::vector<int> versions;      // -1 once merged into another vertex
+    std::vector<char> faceAlive;
+    int aliveFaces;
+    std::priority_queue<Collapse> heap;
+
+    static uint64_t edgeKey(int a, int b) {
+        if (a > b) std::swap(a, b);
+        return ((uint64_t) a << 32) | (uint32_t) b;
+    }
+
+    bool plane(int f, Vector3f &normal, double &d) const {
+        const Vector3f &a = positions[faces[f][0]];
+        normal = Vector3f::cross(positions[faces[f][1]] - a, positions[faces[f][2]] - a);
+        float length = normal.length();
+        if (length == 0) {
+            return false;
+        }
+        normal = normal / length;
+        d = -Vector3f::dot(normal, a);
+        return true;
+    }
+
+    // Cheapest position for the merged vertex. The minimizer of the quadric is only
+    // trusted near the edge, and every position stays inside the original bounds, so that
+    // all levels fit into the bounds of the full mesh.
+    void push(int a, int b) {
+        Collapse collapse;
+        collapse.a = a;
+        collapse.b = b;
+        collapse.versionA = versions[a];
+        collapse.versionB = versions[b];
+        Quadric quadric = quadrics[a] + quadrics[b];
+
+        Vector3f midpoint = (positions[a] + positions[b]) / 2;
+        Vector3f candidates[4] = {positions[a], positions[b], midpoint, midpoint};
+        int count = 3;
+        Vector3f optimum;
+        if (quadric.minimize(optimum) && (optimum - midpoint).length() <= (positions[a] - positions[b]).length()) {
+            candidates[count++] = optimum;
+        }
+        collapse.cost = MAXFLOAT;
+        for (int i = 0; i < count; i++) {
+            Vector3f p = candidates[i];
+            for (int axis = 0; axis < 3; axis++) {
+                p[axis] = std::min(std::max(p[axis], bounds.getAxis(axis).getMin()), bounds.getAxis(axis).getMax());
+            }
+            double cost = quadric.evaluate(p);
+            if (cost < collapse.cost) {
+                collapse.cost = cost;
+                collapse.position = p;
+            }
+        }
+        heap.push(collapse);
+    }
+
+    // Whether moving a and b to the new position turns a remaining triangle over
+    bool flips(const Collapse &collapse) const {
+        for (int vertex : {collapse.a, collapse.b}) {
+            for (int f : vertexFaces[vertex]) {
+                if (!faceAlive[f]) continue;
+                const Mesh::TriangleIndex &face = faces[f];
+                bool hasA = face[0] == collapse.a || face[1] == collapse.a || face[2] == collapse.a;
+                bool hasB = face[0] == collapse.b || face[1] == collapse.b || face[2] == collapse.b;
+                if (hasA && hasB) continue;
+
+                Vector3f corners[3], moved[3];
+                for (int k = 0; k < 3; k++) {
+                    corners[k] = positions[face[k]];
+                    moved[k] = face[k] == vertex ? collapse.position : corners[k];
+                }
+                Vector3f before = Vector3f::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                Vector3f after = Vector3f::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                if (Vector3f::dot(before, after) <= 0.2f * before.length() * after.length()) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void apply(const Collapse &collapse) {
+        int a = collapse.a, b = collapse.b;
+        positions[a] = collapse.position;
+        quadrics[a] = quadrics[a] + quadrics[b];
+
+        for (int f : vertexFaces[b]) {
+            if (!faceAlive[f]) continue;
+            Mesh::TriangleIndex &face = faces[f];
+            if (face[0] == a || face[1] == a || face[2] == a) {
+                faceAlive[f] = 0;
+                aliveFaces--;
+            } else {
+                for (int k = 0; k < 3; k++) {
+                    if (face[k] == b) face[k] = a;
+                }
+                vertexFaces[a].push_back(f);
+            }
+        }
+        std::vector<int>().swap(vertexFaces[b]);
+        versions[b] = -1;
+        versions[a]++;
+
+        std::vector<int> &remaining = vertexFaces[a];
+        remaining.erase(std::remove_if(remaining.begin(), remaining.end(), [this](int f) {
+            return !faceAlive[f];
+        }), remaining.end());
+
+        std::vector<int> neighbors;
+        for (int f : remaining) {
+            for (int k = 0; k < 3; k++) {
+                if (faces[f][k] != a) neighbors.push_back(faces[f][k]);
+            }
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        for (int neighbor : neighbors) {
+            push(a, neighbor);
+        }
+    }
+};
+
+// Point of the triangle abc closest to p (Ericson, "Real-Time Collision Detection", 5.1.5)
+Vector3f closestPointOnTriangle(const Vector3f &p, const Vector3f &a, const Vector3f &b, const Vector3f &c) {
+    Vector3f ab = b - a, ac = c - a, ap = p - a;
+    float d1 = Vector3f::dot(ab, ap), d2 = Vector3f::dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+
+    Vector3f bp = p - b;
+    float d3 = Vector3f::dot(ab, bp), d4 = Vector3f::dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+
+    Vector3f cp = p - c;
+    float d5 = Vector3f::dot(ab, cp), d6 = Vector3f::dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    float denominator = 1 / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Largest distance from a vertex of from to the surface of to
+float surfaceDistance(const Mesh &from, const Mesh &to) {
+    std::vector<char> used(from.v.size(), 0);
+    for (const Mesh::TriangleIndex &triangle : from.t) {
+        used[triangle[0]] = used[triangle[1]] = used[triangle[2]] = 1;
+    }
+    float distance = 0;
+    for (int i = 0; i < (int) from.v.size(); i++) {
+        if (used[i]) distance = std::max(distance, to.getDistance(from.v[i]));
+    }
+    return distance;
+}
+
+}
+
+Mesh::Mesh(const std::vector<Vector3f> &vertices, const std::vector<TriangleIndex> &triangles, Material *material)
+        : Object3D(material) {
+    storage.v = vertices;
+    storage.t = triangles;
+    if (!storage.t.empty()) {
+        computeNormal();
+        computeAABB();
+        buildBVH();
+    }
+    bindStorage();
+}
+
+void Mesh::buildLODs(int levels) {
+    lods.clear();
+    lodErrors.clear();
+    if (t.empty()) {
+        printf("Cannot simplify %s\n", sourcePath.c_str());
+        return;
+    }
+
+    Simplifier simplifier(v, t, aabb);
+    int target = (int) t.size();
+    for (int level = 1; level <= levels; level++) {
+        target /= 2;
+        if (target < 4) break;
+        simplifier.simplify(target);
+
+        std::vector<Vector3f> vertices;
+        std::vector<TriangleIndex> triangles;
+        simplifier.extract(vertices, triangles);
+        if (!lods.empty() && triangles.size() >= lods.back()->t.size()) break;
+        auto lod = std::make_shared<const Mesh>(vertices, triangles, material);
+
+        // Hausdorff distance to this mesh, sampled at the vertices of both sides, and never
+        // below the error of a finer level
+        float error = std::max(surfaceDistance(*this, *lod), surfaceDistance(*lod, *this));
+        if (!lodErrors.empty()) error = std::max(error, lodErrors.back());
+        lods.push_back(lod);
+        lodErrors.push_back(error);
+    }
+}
+
+float Mesh::getDistance(const Vector3f &p) const {
+    if (nodes.empty()) {
+        return MAXFLOAT;
+    }
+
+    // Squared distance from p to the box of a node
+    auto boxDistance = [&](const BVHNode &node) {
+        float squared = 0;
+        for (int i = 0; i < 3; i++) {
+            float outside = std::max(std::max(node.min[i] - p[i], p[i] - node.max[i]), 0.0f);
+            squared += outside * outside;
+        }
+        return squared;
+    };
+
+    float best = MAXFLOAT;
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BVHNode &node = nodes[stack[--top]];
+        if (boxDistance(node) >= best) continue;
+
+        if (node.count > 0) {
+            TrianglePacket decoded;
+            if (compactData != nullptr) decodeLeaf(node, decoded);
+            const TrianglePacket &packet = compactData == nullptr ? packets[node.offset] : decoded;
+            for (int lane = 0; lane < node.count; lane++) {
+                Vector3f a(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+                Vector3f b = a + Vector3f(packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane]);
+                Vector3f c = a + Vector3f(packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane]);
+                best = std::min(best, (closestPointOnTriangle(p, a, b, c) - p).squaredLength());
+            }
+            continue;
+        }
+
+        // Push the farther child first, so that the nearer one shrinks best before it is tested
+        int index = (int) (&node - nodes.data());
+        int left = index + 1, right = node.offset;
+        if (boxDistance(nodes[left]) < boxDistance(nodes[right])) std::swap(left, right);
+        stack[top++] = left;
+        stack[top++] = right;
+    }
+    return best == MAXFLOAT ? MAXFLOAT : std::sqrt(best);
+}
+
+const Mesh *Mesh::getLOD(int level) const {
+    return level == 0 ? this : lods[level - 1].get();
+}
+
+float Mesh::getLODError(int level) const {
+    return level == 0 ? 0 : lodErrors[level - 1];
+}
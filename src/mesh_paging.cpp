@@ -0,0 +1,384 @@
+//
+// Implemented independently
+//
+// Paged geometry of Mesh, see Mesh::page(). The page file holds a header, the nodes
+// above the clusters and a table of clusters, followed by one page aligned block per
+// cluster with its nodes, triangle packets and packet normals.
+//
+#include "mesh.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <mutex>
+
+namespace {
+
+const char PagesMagic[8] = {'R', 'T', 'P', 'A', 'G', 'E', 'S', '\0'};
+const uint32_t PagesVersion = 1;
+const uint64_t PageSize = 4096;
+const uint64_t SectionAlignment = 64;
+// Subtrees with at most this many triangles become clusters, about 50 KB each
+const int ClusterTriangles = 1024;
+
+struct PagesHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t packetWidth;
+    uint32_t nodeSize;
+    uint32_t packetSize;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    uint64_t topNodeCount;
+    uint64_t clusterCount;
+    float min[3], max[3];
+};
+
+struct ClusterInfo {
+    uint64_t offset;        // of the block in the file, page aligned
+    uint32_t nodeCount;
+    uint32_t packetCount;
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Offsets inside the block of a cluster, whose nodes come first
+struct ClusterLayout {
+    uint64_t packets, normals, bytes;
+
+    ClusterLayout(const ClusterInfo &cluster, uint64_t nodeSize) {
+        packets = alignUp(cluster.nodeCount * nodeSize, SectionAlignment);
+        normals = alignUp(packets + cluster.packetCount * sizeof(TrianglePacket), SectionAlignment);
+        bytes = normals + cluster.packetCount * TrianglePacketWidth * sizeof(Vector3f);
+    }
+};
+
+}
+
+struct Mesh::Paging {
+    std::unique_ptr<MappedFile> file;
+    std::vector<BVHNode> topNodes;      // leaves have count 1 and the cluster as offset
+    std::vector<ClusterInfo> clusters;
+    std::vector<uint64_t> clusterBytes;
+
+    std::mutex mutex;
+    std::list<int> recentlyUsed;        // resident clusters, most recently used first
+    std::vector<std::list<int>::iterator> positions;
+    std::vector<char> resident;
+    PagingStatistics statistics;
+
+    // Marks the cluster as used and returns its block, evicting others if over budget
+    const char *touch(int cluster) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (resident[cluster]) {
+            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, positions[cluster]);
+        } else {
+            resident[cluster] = 1;
+            recentlyUsed.push_front(cluster);
+            positions[cluster] = recentlyUsed.begin();
+            statistics.pageIns++;
+            statistics.residentBytes += clusterBytes[cluster];
+            file->prefetch(clusters[cluster].offset, clusterBytes[cluster]);
+            evict();
+        }
+        return file->getData() + clusters[cluster].offset;
+    }
+
+    // The most recently used cluster always stays, even if it alone exceeds the budget
+    void evict() {
+        while (statistics.residentBytes > statistics.budget && recentlyUsed.size() > 1) {
+            int victim = recentlyUsed.back();
+            recentlyUsed.pop_back();
+            resident[victim] = 0;
+            statistics.residentBytes -= clusterBytes[victim];
+            statistics.evictions++;
+            file->release(clusters[victim].offset, clusterBytes[victim]);
+        }
+    }
+};
+
+bool Mesh::page(size_t residencyBudget) {
+    if (paging != nullptr) {
+        std::lock_guard<std::mutex> lock(paging->mutex);
+        paging->statistics.budget = residencyBudget;
+        paging->evict();
+        return true;
+    }
+    if (sourcePath.empty() || compactData != nullptr || nodes.empty()) {
+        printf("Cannot page %s\n", sourcePath.c_str());
+        return false;
+    }
+
+    std::string path = sourcePath + ".meshpages";
+    MappedFile source(sourcePath.c_str());
+    if (!source.isOpen()) {
+        printf("Cannot open %s\n", sourcePath.c_str());
+        return false;
+    }
+    if (!openPages(path, source)) {
+        writePages(path, source);
+        if (!openPages(path, source)) {
+            return false;
+        }
+    }
+    paging->statistics.budget = residencyBudget;
+
+    storage = Storage();
+    cache.reset();
+    bindStorage();
+    return true;
+}
+
+Mesh::PagingStatistics Mesh::getPagingStatistics() const {
+    if (paging == nullptr) {
+        return PagingStatistics();
+    }
+    std::lock_guard<std::mutex> lock(paging->mutex);
+    return paging->statistics;
+}
+
+void Mesh::resetPagingStatistics() {
+    if (paging != nullptr) {
+        std::lock_guard<std::mutex> lock(paging->mutex);
+        paging->statistics.pageIns = 0;
+        paging->statistics.evictions = 0;
+    }
+}
+
+bool Mesh::intersectPaged(const Ray &r, Hit &h, float tmin) const {
+    Paging &pages = *paging;
+    const Vector3f &o = r.getOrigin();
+    const Vector3f &d = r.getDirection();
+    return traverse(pages.topNodes.data(), r, h, tmin, [&](const BVHNode &top) {
+        const ClusterInfo &cluster = pages.clusters[top.offset];
+        ClusterLayout layout(cluster, sizeof(BVHNode));
+        const char *block = pages.touch(top.offset);
+        auto clusterNodes = (const BVHNode *) block;
+        auto clusterPackets = (const TrianglePacket *) (block + layout.packets);
+        auto clusterNormals = (const Vector3f *) (block + layout.normals);
+
+        return traverse(clusterNodes, r, h, tmin, [&](const BVHNode &node) {
+            float tmax = h.getT(), u, v;
+            int lane = intersectTrianglePacket(clusterPackets[node.offset], o, d, tmin, tmax, u, v);
+            if (lane < 0) {
+                return false;
+            }
+            h.set(tmax, material, clusterNormals[node.offset * TrianglePacketWidth + lane]);
+            return true;
+        });
+    });
+}
+
+bool Mesh::occludedPaged(const Ray &r, float tmin, float tmax) const {
+    Paging &pages = *paging;
+    const Vector3f &o = r.getOrigin();
+    const Vector3f &d = r.getDirection();
+    Hit h(tmax, nullptr, Vector3f::ZERO);
+    return traverse(pages.topNodes.data(), r, h, tmin, [&](const BVHNode &top) {
+        const ClusterInfo &cluster = pages.clusters[top.offset];
+        ClusterLayout layout(cluster, sizeof(BVHNode));
+        const char *block = pages.touch(top.offset);
+        auto clusterNodes = (const BVHNode *) block;
+        auto clusterPackets = (const TrianglePacket *) (block + layout.packets);
+
+        return traverse(clusterNodes, r, h, tmin, [&](const BVHNode &node) {
+            float t = tmax, u, v;
+            return intersectTrianglePacket(clusterPackets[node.offset], o, d, tmin, t, u, v) >= 0;
+        }, true);
+    }, true);
+}
+
+void Mesh::getCrossingsPaged(const Ray &r, std::vector<Crossing> &crossings) const {
+    Paging &pages = *paging;
+    const Vector3f &o = r.getOrigin();
+    const Vector3f &d = r.getDirection();
+    Hit h(MAXFLOAT, nullptr, Vector3f::ZERO);
+    traverse(pages.topNodes.data(), r, h, -MAXFLOAT, [&](const BVHNode &top) {
+        const ClusterInfo &cluster = pages.clusters[top.offset];
+        ClusterLayout layout(cluster, sizeof(BVHNode));
+        const char *block = pages.touch(top.offset);
+        auto clusterNodes = (const BVHNode *) block;
+        auto clusterPackets = (const TrianglePacket *) (block + layout.packets);
+
+        return traverse(clusterNodes, r, h, -MAXFLOAT, [&](const BVHNode &node) {
+            addCrossings(clusterPackets[node.offset], node.count, o, d, crossings);
+            return false;
+        });
+    });
+}
+
+bool Mesh::openPages(const std::string &path, const MappedFile &source) {
+    std::unique_ptr<MappedFile> file(new MappedFile(path.c_str()));
+    if (!file->isOpen() || file->getSize() < sizeof(PagesHeader)) {
+        return false;
+    }
+
+    PagesHeader header;
+    memcpy(&header, file->getData(), sizeof(header));
+    if (memcmp(header.magic, PagesMagic, sizeof(PagesMagic)) != 0 || header.version != PagesVersion
+        || header.packetWidth != TrianglePacketWidth || header.nodeSize != sizeof(BVHNode)
+        || header.packetSize != sizeof(TrianglePacket) || header.sourceSize != source.getSize()) {
+        return false;
+    }
+    bool touched = header.sourceTime != source.getModificationTime();
+    if (touched && header.sourceHash != source.getContentHash()) {
+        return false;
+    }
+    uint64_t tableBytes = header.topNodeCount * sizeof(BVHNode) + header.clusterCount * sizeof(ClusterInfo);
+    if (header.topNodeCount == 0 || header.clusterCount == 0 || tableBytes > file->getSize() - sizeof(header)) {
+        return false;
+    }
+
+    auto pages = std::make_shared<Paging>();
+    const char *table = file->getData() + sizeof(header);
+    pages->topNodes.resize(header.topNodeCount);
+    memcpy(&pages->topNodes[0], table, header.topNodeCount * sizeof(BVHNode));
+    pages->clusters.resize(header.clusterCount);
+    memcpy(&pages->clusters[0], table + header.topNodeCount * sizeof(BVHNode), header.clusterCount * sizeof(ClusterInfo));
+    for (const ClusterInfo &cluster : pages->clusters) {
+        uint64_t bytes = ClusterLayout(cluster, sizeof(BVHNode)).bytes;
+        if (cluster.offset % PageSize != 0 || cluster.offset > file->getSize() || bytes > file->getSize() - cluster.offset) {
+            return false;
+        }
+        pages->clusterBytes.push_back(bytes);
+    }
+
+    pages->positions.resize(header.clusterCount);
+    pages->resident.resize(header.clusterCount, 0);
+    pages->statistics.residentBytes = tableBytes;
+    pages->file = std::move(file);
+    aabb = AABB(Vector3f(header.min[0], header.min[1], header.min[2]),
+                Vector3f(header.max[0], header.max[1], header.max[2]));
+    paging = pages;
+    // As for the mesh cache, a matching hash makes the new time of the source the valid one
+    if (touched) {
+        int64_t time = source.getModificationTime();
+        MappedFile::patch(path.c_str(), offsetof(PagesHeader, sourceTime), &time, sizeof(time));
+    }
+    return true;
+}
+
+void Mesh::writePages(const std::string &path, const MappedFile &source) const {
+    // Triangle count and end of the subtree of every node. Children come after their
+    // parent in the depth first layout, so one backwards pass suffices.
+    int nodeCount = (int) nodes.size();
+    std::vector<int> triangles(nodeCount), ends(nodeCount);
+    for (int i = nodeCount - 1; i >= 0; i--) {
+        if (nodes[i].count > 0) {
+            triangles[i] = nodes[i].count;
+            ends[i] = i + 1;
+        } else {
+            triangles[i] = triangles[i + 1] + triangles[nodes[i].offset];
+            ends[i] = ends[nodes[i].offset];
+        }
+    }
+
+    // The nodes above the clusters, again depth first, and the root node of every cluster
+    std::vector<BVHNode> topNodes;
+    std::vector<int> roots;
+    std::vector<int> stack(1, 0), parents(1, -1);
+    while (!stack.empty()) {
+        int index = stack.back(), parent = parents.back();
+        stack.pop_back();
+        parents.pop_back();
+        if (parent >= 0) {
+            topNodes[parent].offset = (int) topNodes.size();
+        }
+        BVHNode top = nodes[index];
+        if (triangles[index] <= ClusterTriangles) {
+            top.count = 1;
+            top.offset = (int) roots.size();
+            roots.push_back(index);
+            topNodes.push_back(top);
+        } else {
+            top.count = 0;
+            topNodes.push_back(top);
+            // The left child directly follows, the right one is linked once it is placed
+            stack.push_back(nodes[index].offset);
+            parents.push_back((int) topNodes.size() - 1);
+            stack.push_back(index + 1);
+            parents.push_back(-1);
+        }
+    }
+
+    PagesHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PagesMagic, sizeof(PagesMagic));
+    header.version = PagesVersion;
+    header.packetWidth = TrianglePacketWidth;
+    header.nodeSize = sizeof(BVHNode);
+    header.packetSize = sizeof(TrianglePacket);
+    header.sourceSize = source.getSize();
+    header.sourceTime = source.getModificationTime();
+    header.sourceHash = source.getContentHash();
+    header.topNodeCount = topNodes.size();
+    header.clusterCount = roots.size();
+    for (int axis = 0; axis < 3; axis++) {
+        header.min[axis] = aabb.getAxis(axis).getMin();
+        header.max[axis] = aabb.getAxis(axis).getMax();
+    }
+
+    std::vector<ClusterInfo> clusters(roots.size());
+    uint64_t offset = sizeof(header) + topNodes.size() * sizeof(BVHNode) + clusters.size() * sizeof(ClusterInfo);
+    for (int i = 0; i < (int) roots.size(); i++) {
+        clusters[i].offset = alignUp(offset, PageSize);
+        clusters[i].nodeCount = (uint32_t) (ends[roots[i]] - roots[i]);
+        clusters[i].packetCount = 0;
+        for (int node = roots[i]; node < ends[roots[i]]; node++) {
+            clusters[i].packetCount += nodes[node].count > 0;
+        }
+        offset = clusters[i].offset + ClusterLayout(clusters[i], sizeof(BVHNode)).bytes;
+    }
+
+    std::string temporaryPath = path + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if (file == nullptr) {
+        printf("Cannot write %s\n", path.c_str());
+        return;
+    }
+    std::vector<char> padding(PageSize, 0);
+    uint64_t position = 0;
+    bool written = true;
+    auto write = [&](uint64_t at, const void *data, uint64_t bytes) {
+        written = written && fwrite(padding.data(), 1, at - position, file) == at - position;
+        written = written && (bytes == 0 || fwrite(data, bytes, 1, file) == 1);
+        position = at + bytes;
+    };
+    write(0, &header, sizeof(header));
+    write(position, topNodes.data(), topNodes.size() * sizeof(BVHNode));
+    write(position, clusters.data(), clusters.size() * sizeof(ClusterInfo));
+
+    // Node offsets become relative to the cluster: right children to its first node,
+    // leaves to its first packet, which is the packet of the first leaf
+    for (int i = 0; i < (int) roots.size(); i++) {
+        const ClusterInfo &cluster = clusters[i];
+        ClusterLayout layout(cluster, sizeof(BVHNode));
+        int firstPacket = -1;
+        std::vector<BVHNode> clusterNodes(nodes.begin() + roots[i], nodes.begin() + ends[roots[i]]);
+        for (BVHNode &node : clusterNodes) {
+            if (node.count > 0) {
+                if (firstPacket < 0) firstPacket = node.offset;
+                node.offset -= firstPacket;
+            } else {
+                node.offset -= roots[i];
+            }
+        }
+        write(cluster.offset, clusterNodes.data(), clusterNodes.size() * sizeof(BVHNode));
+        write(cluster.offset + layout.packets, &packets[firstPacket], cluster.packetCount * sizeof(TrianglePacket));
+        // Paged leaves have no triangle ids to look normals up by, so they are stored per lane
+        std::vector<Vector3f> clusterNormals(cluster.packetCount * TrianglePacketWidth);
+        for (int slot = 0; slot < (int) clusterNormals.size(); slot++) {
+            int triId = packetTriangles[firstPacket * TrianglePacketWidth + slot];
+            if (triId >= 0) clusterNormals[slot] = n[triId];
+        }
+        write(cluster.offset + layout.normals, clusterNormals.data(), clusterNormals.size() * sizeof(Vector3f));
+    }
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        printf("Cannot write %s\n", path.c_str());
+        remove(temporaryPath.c_str());
+    }
+}
@@ -0,0 +1,293 @@
+//
+// Implemented independently
+//
+#include "obj_loader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include "mapped_file.hpp"
+
+namespace {
+
+// Lines parsed by one thread. Negative (relative) indices may point into previous
+// chunks, so they are stored relative to the start of this chunk and remembered in
+// relative to be shifted once the element counts of the previous chunks are known.
+struct Chunk {
+    std::vector<Vector3f> positions;
+    std::vector<Vector2f> texcoords;
+    std::vector<Vector3f> normals;
+    std::vector<ObjData::Corner> corners;
+    std::vector<int> relative;      // 3 * corner + component
+    bool valid = true;
+};
+
+const double PowersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline const char *skipBlanks(const char *p, const char *end) {
+    while (p < end && isBlank(*p)) p++;
+    return p;
+}
+
+inline const char *skipLine(const char *p, const char *end) {
+    while (p < end && *p != '\n') p++;
+    return p < end ? p + 1 : end;
+}
+
+// [+-]digits[.digits][(e|E)[+-]digits]; returns p unchanged if there is no number
+const char *parseFloat(const char *p, const char *end, float &value) {
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; p < end && isDigit(*p); p++, digits++) {
+        if (mantissa < 100000000000000000ull) {
+            mantissa = mantissa * 10 + (*p - '0');
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++, digits++) {
+            if (mantissa < 100000000000000000ull) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0) {
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            negativeExponent = *q == '-';
+            q++;
+        }
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            for (; q < end && isDigit(*q); q++) {
+                if (e < 10000) e = e * 10 + (*q - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = (double) mantissa;
+    if (exponent < 0) {
+        result = -exponent <= 22 ? result / PowersOf10[-exponent] : result * std::pow(10.0, exponent);
+    } else if (exponent > 0) {
+        result = exponent <= 22 ? result * PowersOf10[exponent] : result * std::pow(10.0, exponent);
+    }
+    value = (float) (negative ? -result : result);
+    return p;
+}
+
+// [+-]digits; returns p unchanged if there is no number
+const char *parseInt(const char *p, const char *end, int &value) {
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end || !isDigit(*p)) {
+        return start;
+    }
+    int result = 0;
+    for (; p < end && isDigit(*p); p++) {
+        result = result * 10 + (*p - '0');
+    }
+    value = negative ? -result : result;
+    return p;
+}
+
+const char *parseFloats(const char *p, const char *end, float *values, int count) {
+    for (int i = 0; i < count; i++) {
+        p = skipBlanks(p, end);
+        values[i] = 0;
+        p = parseFloat(p, end, values[i]);
+    }
+    return p;
+}
+
+// Converts a 1 based OBJ index to a 0 based one. Negative indices count back from the
+// elements defined so far, of which this chunk only knows its own, and are marked for relocation.
+inline int resolveIndex(int index, int localCount, Chunk &chunk, int slot) {
+    if (index > 0) {
+        return index - 1;
+    }
+    if (index < 0) {
+        chunk.relative.push_back(slot);
+        return localCount + index;
+    }
+    chunk.valid = false;
+    return -1;
+}
+
+// v[/[vt][/vn]] groups up to the end of the line, fan triangulated
+const char *parseFace(const char *p, const char *end, Chunk &chunk, std::vector<ObjData::Corner> &polygon) {
+    polygon.clear();
+    while (true) {
+        p = skipBlanks(p, end);
+        int values[3] = {0, 0, 0};
+        const char *next = parseInt(p, end, values[0]);
+        if (next == p) break;
+        p = next;
+        for (int component = 1; component < 3 && p < end && *p == '/'; component++) {
+            p = parseInt(p + 1, end, values[component]);
+        }
+
+        ObjData::Corner corner;
+        corner.position = values[0];
+        corner.texcoord = values[1];
+        corner.normal = values[2];
+        polygon.push_back(corner);
+    }
+
+    for (int i = 1; i + 1 < (int) polygon.size(); i++) {
+        const ObjData::Corner *fan[3] = {&polygon[0], &polygon[i], &polygon[i + 1]};
+        for (auto raw : fan) {
+            int slot = 3 * (int) chunk.corners.size();
+            ObjData::Corner corner;
+            corner.position = resolveIndex(raw->position, (int) chunk.positions.size(), chunk, slot);
+            corner.texcoord = raw->texcoord == 0 ? -1
+                    : resolveIndex(raw->texcoord, (int) chunk.texcoords.size(), chunk, slot + 1);
+            corner.normal = raw->normal == 0 ? -1
+                    : resolveIndex(raw->normal, (int) chunk.normals.size(), chunk, slot + 2);
+            chunk.corners.push_back(corner);
+        }
+    }
+    return p;
+}
+
+void parseChunk(const char *p, const char *end, Chunk &chunk) {
+    std::vector<ObjData::Corner> polygon;
+    while (p < end) {
+        p = skipBlanks(p, end);
+        if (p + 1 < end && p[0] == 'v' && isBlank(p[1])) {
+            float values[3];
+            p = parseFloats(p + 2, end, values, 3);
+            chunk.positions.emplace_back(values[0], values[1], values[2]);
+        } else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+            float values[2];
+            p = parseFloats(p + 3, end, values, 2);
+            chunk.texcoords.emplace_back(values[0], values[1]);
+        } else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+            float values[3];
+            p = parseFloats(p + 3, end, values, 3);
+            chunk.normals.emplace_back(values[0], values[1], values[2]);
+        } else if (p + 1 < end && p[0] == 'f' && isBlank(p[1])) {
+            p = parseFace(p + 2, end, chunk, polygon);
+        }
+        p = skipLine(p, end);
+    }
+}
+
+}
+
+bool loadObj(const char *filename, ObjData &data, int threads) {
+    auto start = std::chrono::steady_clock::now();
+    data = ObjData();
+
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        printf("Cannot open %s\n", filename);
+        return false;
+    }
+    size_t size = file.getSize();
+    if (size == 0) {
+        return true;
+    }
+    file.adviseSequential();
+    const char *begin = file.getData(), *end = begin + size;
+
+    // Chunks of at least 1 MB, cut right after a newline
+    const size_t MinChunkSize = 1 << 20;
+    if (threads <= 0) {
+        threads = std::max(1, (int) std::thread::hardware_concurrency());
+    }
+    int chunkCount = (int) std::max<size_t>(1, std::min<size_t>(threads, size / MinChunkSize));
+    std::vector<const char *> bounds(chunkCount + 1);
+    bounds[0] = begin;
+    bounds[chunkCount] = end;
+    for (int i = 1; i < chunkCount; i++) {
+        const char *p = std::max(begin + size / chunkCount * i, bounds[i - 1]);
+        while (p < end && *p != '\n') p++;
+        bounds[i] = p < end ? p + 1 : end;
+    }
+
+    std::vector<Chunk> chunks(chunkCount);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < chunkCount; i++) {
+        workers.emplace_back(parseChunk, bounds[i], bounds[i + 1], std::ref(chunks[i]));
+    }
+    parseChunk(bounds[0], bounds[1], chunks[0]);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    size_t positionCount = 0, texcoordCount = 0, normalCount = 0, cornerCount = 0;
+    for (const Chunk &chunk : chunks) {
+        positionCount += chunk.positions.size();
+        texcoordCount += chunk.texcoords.size();
+        normalCount += chunk.normals.size();
+        cornerCount += chunk.corners.size();
+    }
+    data.positions.reserve(positionCount);
+    data.texcoords.reserve(texcoordCount);
+    data.normals.reserve(normalCount);
+    data.corners.reserve(cornerCount);
+
+    bool valid = true;
+    for (Chunk &chunk : chunks) {
+        for (int slot : chunk.relative) {
+            ObjData::Corner &corner = chunk.corners[slot / 3];
+            int &index = slot % 3 == 0 ? corner.position : slot % 3 == 1 ? corner.texcoord : corner.normal;
+            index += (int) (slot % 3 == 0 ? data.positions.size()
+                            : slot % 3 == 1 ? data.texcoords.size() : data.normals.size());
+            valid &= index >= 0;
+        }
+        valid &= chunk.valid;
+
+        data.positions.insert(data.positions.end(), chunk.positions.begin(), chunk.positions.end());
+        data.texcoords.insert(data.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+        data.normals.insert(data.normals.end(), chunk.normals.begin(), chunk.normals.end());
+        data.corners.insert(data.corners.end(), chunk.corners.begin(), chunk.corners.end());
+    }
+
+    for (const ObjData::Corner &corner : data.corners) {
+        valid &= corner.position >= 0 && corner.position < (int) positionCount;
+        valid &= corner.texcoord < (int) texcoordCount;
+        valid &= corner.normal < (int) normalCount;
+    }
+    if (!valid) {
+        printf("Invalid face index in %s\n", filename);
+        data = ObjData();
+        return false;
+    }
+
+    data.bytes = size;
+    data.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
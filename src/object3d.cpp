@@ -0,0 +1,50 @@
+//
+// Implemented independently
+//
+#include "object3d.hpp"
+#include "instance.hpp"
+#include <algorithm>
+
+void Object3D::getCrossings(const Ray &r, std::vector<Crossing> &crossings) const {
+    float tmin = -MAXFLOAT;
+    Hit h;
+    while (intersect(r, h, tmin)) {
+        // Hits inside instances get their surface in object space and the normal carried out
+        computeHitSurface(r, h);
+        crossings.push_back({h.getT(), Vector3f::dot(h.getNormal(), r.getDirection()) < 0});
+        float next = h.getT() + 0.0001f;
+        if (next <= tmin) break;
+        tmin = next;
+        h = Hit();
+    }
+}
+
+void Object3D::getIntervals(const Ray &r, float tmin, float tmax, std::vector<Interval> &intervals) const {
+    // Reused, so that media do not allocate for every ray. A query nested in getCrossings()
+    // (e.g. a medium inside the boundary of another one) gets a vector of its own.
+    static thread_local std::vector<Crossing> reused;
+    static thread_local bool busy = false;
+    std::vector<Crossing> nested;
+    std::vector<Crossing> &crossings = busy ? nested : reused;
+    bool outer = !busy;
+    busy = true;
+    crossings.clear();
+    getCrossings(r, crossings);
+    if (outer) busy = false;
+    std::sort(crossings.begin(), crossings.end());
+
+    bool inside = false;
+    float enter = 0;
+    for (const Crossing &crossing : crossings) {
+        if (crossing.entering && !inside) {
+            inside = true;
+            enter = crossing.t;
+        } else if (!crossing.entering && inside) {
+            inside = false;
+            float from = std::max(enter, tmin), to = std::min(crossing.t, tmax);
+            if (from < to) {
+                intervals.emplace_back(from, to);
+            }
+        }
+    }
+}
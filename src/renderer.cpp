@@ -0,0 +1,167 @@
+//
+// Rendering loop moved from main.cpp, copied from PA1
+// Other parts implemented independently
+//
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "renderer.hpp"
+#include "scene.hpp"
+#include "image.hpp"
+#include "camera.hpp"
+#include "group.hpp"
+#include "material.hpp"
+#include "random.hpp"
+#include "instance.hpp"
+#include "wavefront.hpp"
+
+using namespace std;
+
+Vector3f Renderer::trace(const Ray &ray, Scene *scene, Object3D* lights, int depth) {
+    Hit hit;
+    bool intersect = scene->getAccelerator()->intersect(ray, hit, 0);
+    if (!intersect) {
+        return scene->getBackgroundColor();
+    }
+    computeHitSurface(ray, hit);
+
+    auto* material = hit.getMaterial();
+
+    Vector3f attenuation;
+    Ray scattered(Vector3f(0), Vector3f(0));
+    Vector3f emmision = material->scatter(ray, hit, attenuation, scattered, lights);
+
+    // This has to come first
+    if (emmision != Vector3f::ZERO)
+        return emmision;
+
+    // Russian Roulette
+    if (attenuation.length() < rand01())
+        return Vector3f::ZERO;
+
+    // Prevent stack overflow
+    if (depth >= 50)
+        return emmision;
+
+    Vector3f finalColor = emmision
+            + attenuation * trace(scattered, scene, lights, depth + 1);
+    return finalColor;
+}
+
+// Mean of the samples of a pixel, leaving out NaNs and scaling down fireflies
+static Vector3f averageSamples(const Vector3f *colors, int samples) {
+    Vector3f color;
+    int count = samples;
+    for (int k = 0; k < samples; k++) {
+        Vector3f newColor = colors[k];
+        if(newColor.x() != newColor.x() || newColor.y() != newColor.y() || newColor.z() != newColor.z()) {
+            count--;
+            continue;
+        }
+
+        float l = newColor.length();
+        if(l > 100) {
+            newColor = newColor / l * color.length();
+        }
+        color += newColor;
+    }
+    color = color / count;
+    return color;
+}
+
+// Blends the gamma corrected color into the pixel, which holds the previous rounds
+static void storePixel(Image &image, int i, int j, Vector3f color) {
+    for (int k = 0; k < 3; k++)
+        color[k] = pow(color[k], 1.0f / 2.2f);  // Gamma correction (inverse gamma correction)
+
+    image.SetPixel(i, j, image.GetPixel(i, j) / 2.0f + color / 2.0f);
+}
+
+Renderer::Renderer(Scene *scene, int threads, Mode mode) : scene(scene), threads(max(1, threads)), mode(mode) {}
+
+Vector3f Renderer::tracePixel(int i, int j, int samples) const {
+    Camera* camera = scene->getCamera();
+
+    vector<Vector3f> colors;
+    for (int k = 0; k < samples; k++) {
+        float u = i + rand01();
+        float v = j + rand01();
+        Ray ray = camera->generateRay(Vector2f(u, v));
+
+        colors.push_back(trace(ray, scene, scene->getLights(), 0));
+    }
+    return averageSamples(colors.data(), samples);
+}
+
+void Renderer::traceColumnWavefront(int i, int samples, Image &image) const {
+    Camera *camera = scene->getCamera();
+    vector<Ray> rays;
+    for (int j = 0; j < camera->getHeight(); j++) {
+        for (int k = 0; k < samples; k++) {
+            rays.push_back(camera->generateRay(Vector2f(i + rand01(), j + rand01())));
+        }
+    }
+
+    WavefrontTracer tracer(scene, mode == SortedMode);
+    vector<Vector3f> colors;
+    tracer.trace(rays, colors);
+    for (int j = 0; j < camera->getHeight(); j++) {
+        storePixel(image, i, j, averageSamples(&colors[j * samples], samples));
+    }
+}
+
+void Renderer::render(const string &outputFile, int sampleLimit) {
+    // Main RayCasting Logic
+    // Loop over each pixel in the image, shooting a ray
+    // through that pixel and finding its intersection with
+    // the scene.  Write the color at the intersection to that
+    // pixel in your output image.
+    Camera *camera = scene->getCamera();
+    Image image(camera->getWidth(), camera->getHeight());
+
+    vector<std::thread> workers(threads);
+
+    bool firstRound = true;
+    int samples = 16;
+    while (samples < sampleLimit) {
+        if (mode != RecursiveMode) {
+            // One column at a time per thread
+            for (int t = 0; t < threads; t++) {
+                workers[t] = std::thread([this, t, samples, camera, &image]() {
+                    for (int i = t; i < camera->getWidth(); i += threads) {
+                        std::cout << samples << " Rendering: " << i << " / " << camera->getWidth() << std::endl;
+                        traceColumnWavefront(i, samples, image);
+                    }
+                });
+            }
+        } else {
+            for (int i = 0; i < camera->getWidth(); i++) {
+                std::cout << samples << " Rendering: " << i << " / " << camera->getWidth() << std::endl;
+                for (int j = 0; j < camera->getHeight(); j++) {
+                    if(workers[j % threads].joinable())
+                        workers[j % threads].join();
+                    workers[j % threads] = std::thread([this, i, j, samples, &image]() {
+                        storePixel(image, i, j, tracePixel(i, j, samples));
+                    });
+                }
+            }
+        }
+        for (auto &worker : workers) {
+            if (worker.joinable())
+                worker.join();
+        }
+
+        if(!firstRound)
+            samples <<= 1;
+        else
+            firstRound = false;
+
+        auto filename = outputFile.substr(0, outputFile.find_last_of('.')) + "-" + std::to_string(samples) + ".bmp";
+        image.SaveImage(filename.c_str());
+    }
+
+    std::cout << "Done" << std::endl;
+    image.SaveImage(outputFile.c_str());
+}
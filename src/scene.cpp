@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
 #include <cmath>
+#include <functional>
+#include <thread>
 
 #include "scene.hpp"
 #include "camera.hpp"
@@ -11,6 +14,17 @@
 #include "group.hpp"
 #include "image.hpp"
 #include "bvh_node.hpp"
+#include "dynamic_bvh.hpp"
+#include "lazy_bvh_node.hpp"
+#include "compressed_bvh.hpp"
+#include "flat_bvh.hpp"
+#include "uniform_grid.hpp"
+#include "kd_tree.hpp"
+#include "transform.hpp"
+#include "instance.hpp"
+#include "mesh.hpp"
+#include "primitive_pool.hpp"
+#include "ray_batch.hpp"
 
 #define DegreesToRadians(x) ((M_PI * x) / 180.0f)
 
@@ -19,19 +33,174 @@ Scene::Scene() {
     background_color = Vector3f(0, 0, 0);
     group = new Group();
     lights = new Group();
-    bvh_root = nullptr;
+    accelerator = nullptr;
+    pool = new PrimitivePool();
+    accelerator_type = BVHAccelerator;
+    dynamic = false;
+    lazy = false;
+    compressed = false;
+    flat = false;
+    bake_transforms = false;
+    rebuild_threshold = 1.5f;
+    lod_threshold = 1;
 }
 
 Scene::~Scene() {
     delete group;
     delete camera;
     delete lights;
+    delete accelerator;
+    delete pool;
+}
+
+// Batches are only split into chunks of at least this many rays, to amortize starting a thread
+static const int MinRaysPerThread = 1024;
+
+// Calls task(begin, end) for consecutive chunks of [0, count), one per thread
+static void parallelFor(int count, int threads, const std::function<void(int, int)> &task) {
+    if (threads <= 0) {
+        threads = std::max(1, (int) std::thread::hardware_concurrency());
+    }
+    threads = std::max(1, std::min(threads, count / MinRaysPerThread));
+    int chunk = (count + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++) {
+        workers.emplace_back(task, std::min(count, t * chunk), std::min(count, (t + 1) * chunk));
+    }
+    task(0, std::min(count, chunk));
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+bool Scene::intersect(const RayBatch &rays, HitBatch &hits, int threads) const {
+    hits.resize(rays.size());
+    const Accelerator *structure = accelerator;
+    if (structure == nullptr) {
+        printf("Scene has not been built.\n");
+        return false;
+    }
+
+    auto flatBVH = dynamic_cast<const FlatBVH*>(structure);
+    Hit *hitData = hits.getHits();
+    bool *results = hits.getResults();
+    float tmin = rays.getTMin();
+    parallelFor(rays.size(), threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            hitData[i] = Hit(rays.getTMax(i), nullptr, Vector3f::ZERO);
+        }
+        if (flatBVH != nullptr) {
+            flatBVH->intersect(rays.getRays() + begin, hitData + begin, results + begin, end - begin, tmin);
+        } else {
+            for (int i = begin; i < end; i++) {
+                results[i] = structure->intersect(rays.getRay(i), hitData[i], tmin);
+            }
+        }
+        for (int i = begin; i < end; i++) {
+            if (results[i]) {
+                computeHitSurface(rays.getRay(i), hitData[i]);
+            }
+        }
+    });
+    return true;
+}
+
+bool Scene::occluded(const RayBatch &rays, HitBatch &hits, int threads) const {
+    hits.resize(rays.size());
+    const Accelerator *structure = accelerator;
+    if (structure == nullptr) {
+        printf("Scene has not been built.\n");
+        return false;
+    }
+
+    auto flatBVH = dynamic_cast<const FlatBVH*>(structure);
+    bool *results = hits.getResults();
+    float tmin = rays.getTMin();
+    parallelFor(rays.size(), threads, [&](int begin, int end) {
+        if (flatBVH != nullptr) {
+            flatBVH->occluded(rays.getRays() + begin, results + begin, end - begin, tmin, rays.getTMaxs() + begin);
+            return;
+        }
+        for (int i = begin; i < end; i++) {
+            results[i] = structure->occluded(rays.getRay(i), tmin, rays.getTMax(i));
+        }
+    });
+    return true;
 }
 
 void Scene::addObject(Object3D *object) {
+    auto dynamicBVH = dynamic_cast<DynamicBVH*>(accelerator);
+    if (dynamicBVH != nullptr && dynamicBVH->contains(object)) {
+        printf("Object already in the scene\n");
+        return;
+    }
+
     group->addObject(object);
-    if (object->material->isEmissive())
+    // Instances of a BVHNode have no material of their own, their primitives have
+    if (object->material != nullptr && object->material->isEmissive())
         lights->addObject(object);
+
+    if (dynamicBVH != nullptr) {
+        dynamicBVH->insert(object);
+    } else if (accelerator != nullptr) {
+        rebuild();
+    }
+}
+
+void Scene::removeObject(Object3D *object) {
+    group->removeObject(object);
+    lights->removeObject(object);
+
+    auto dynamicBVH = dynamic_cast<DynamicBVH*>(accelerator);
+    if (dynamicBVH != nullptr) {
+        dynamicBVH->remove(object);
+    } else if (accelerator != nullptr) {
+        rebuild();
+    }
+}
+
+void Scene::addSphere(const Vector3f &center, float radius, Material *material) {
+    bool built = accelerator != nullptr;
+    if ((material != nullptr && material->isEmissive()) || (built && !tracesFlatBVH())) {
+        addObject(new Sphere(center, radius, material));
+        return;
+    }
+
+    pool->addSphere(center, radius, material);
+    if (built) {
+        rebuild();
+    }
+}
+
+void Scene::addQuad(const Vector3f &center, const Vector3f &a, const Vector3f &b, Material *material) {
+    bool built = accelerator != nullptr;
+    if ((material != nullptr && material->isEmissive()) || (built && !tracesFlatBVH())) {
+        addObject(new Quad(center, a, b, material));
+        return;
+    }
+
+    pool->addQuad(center, a, b, material);
+    if (built) {
+        rebuild();
+    }
+}
+
+bool Scene::tracesFlatBVH() const {
+    return accelerator_type == BVHAccelerator && flat && !dynamic && !lazy && !compressed;
+}
+
+void Scene::unpool() {
+    std::vector<Sphere> spheres;
+    std::vector<Quad> quads;
+    pool->instantiate(spheres, quads);
+    for (const Sphere &sphere : spheres) {
+        group->addObject(new Sphere(sphere));
+    }
+    for (const Quad &quad : quads) {
+        group->addObject(new Quad(quad));
+    }
+    delete pool;
+    pool = new PrimitivePool();
 }
 
 void Scene::buildScene() {
@@ -40,7 +209,7 @@ void Scene::buildScene() {
         exit(0);
     }
 
-    if (group->getGroupSize() == 0) {
+    if (group->getGroupSize() == 0 && pool->empty()) {
         printf("No objects in the scene.\n");
         exit(0);
     }
@@ -50,5 +219,174 @@ void Scene::buildScene() {
         exit(0);
     }
 
-    bvh_root = new BVHNode(group->getObjects());
+    if (bake_transforms) {
+        bakeTransforms();
+    }
+    if (!tracesFlatBVH()) {
+        unpool();
+    }
+    selectLODs();
+
+    if (dynamic && accelerator_type == BVHAccelerator) {
+        accelerator = new DynamicBVH(group->getObjects());
+    } else {
+        rebuild(true);
+    }
+}
+
+void Scene::bakeTransforms() {
+    std::vector<Object3D*> &lightObjects = lights->getObjects();
+    for (auto &object : group->getObjects()) {
+        auto transform = dynamic_cast<Transform*>(object);
+        if (transform == nullptr)
+            continue;
+
+        Object3D *baked = transform->bake();
+        if (baked == nullptr)
+            continue;
+
+        std::replace(lightObjects.begin(), lightObjects.end(), object, baked);
+        delete transform;
+        object = baked;
+    }
+}
+
+void Scene::rebuild(bool report) {
+    delete accelerator;
+    accelerator = nullptr;
+
+    if (group->getGroupSize() == 0 && pool->empty())
+        return;
+
+    if (accelerator_type == GridAccelerator) {
+        auto grid = new UniformGrid(group->getObjects());
+        if (report) {
+            printf("Uniform grid: %dx%dx%d cells, %.1f bytes/object\n", grid->getResolution(0),
+                   grid->getResolution(1), grid->getResolution(2),
+                   (float) grid->getMemoryUsage() / group->getGroupSize());
+        }
+        accelerator = grid;
+        return;
+    }
+
+    if (accelerator_type == KdTreeAccelerator) {
+        auto kdTree = new KdTree(group->getObjects());
+        if (report) {
+            printf("Kd-tree: %d nodes, %.1f bytes/object\n", kdTree->getNodeCount(),
+                   (float) kdTree->getMemoryUsage() / group->getGroupSize());
+        }
+        accelerator = kdTree;
+        return;
+    }
+
+    if (lazy) {
+        accelerator = new LazyBVHNode(group->getObjects());
+        return;
+    }
+
+    if (flat && !compressed) {
+        // The pooled primitives only need objects until the flat BVH copied them into its packets
+        std::vector<Sphere> pooledSpheres;
+        std::vector<Quad> pooledQuads;
+        pool->instantiate(pooledSpheres, pooledQuads);
+        std::vector<Object3D*> objects = group->getObjects();
+        for (Sphere &sphere : pooledSpheres) objects.push_back(&sphere);
+        for (Quad &quad : pooledQuads) objects.push_back(&quad);
+
+        auto bvh = new BVHNode(objects);
+        auto flatBVH = new FlatBVH(bvh);
+        if (report) {
+            printf("Flat BVH: %d primitives, %.1f bytes/primitive\n", flatBVH->getPrimitiveCount(),
+                   (float) flatBVH->getMemoryUsage() / flatBVH->getPrimitiveCount());
+            if (!pool->empty()) {
+                printf("Primitive pool: %d spheres, %d quads, %.1f bytes/primitive\n", pool->getSphereCount(),
+                       pool->getQuadCount(),
+                       (float) pool->getMemoryUsage() / (pool->getSphereCount() + pool->getQuadCount()));
+            }
+        }
+        accelerator = flatBVH;
+        delete bvh;
+        return;
+    }
+
+    auto bvh = new BVHNode(group->getObjects());
+    if (!compressed) {
+        accelerator = bvh;
+        return;
+    }
+
+    auto compressedBVH = new CompressedBVH(bvh);
+    if (report) {
+        float primitives = (float) compressedBVH->getPrimitiveCount();
+        printf("BVH memory: %.1f bytes/primitive (BVHNode), %.1f bytes/primitive (compressed)\n",
+               bvh->getMemoryUsage() / primitives, compressedBVH->getMemoryUsage() / primitives);
+    }
+    accelerator = compressedBVH;
+    delete bvh;
+}
+
+void Scene::selectLODs() {
+    auto perspective = dynamic_cast<PerspectiveCamera*>(camera);
+    if (perspective == nullptr)
+        return;
+
+    for (auto object : group->getObjects()) {
+        auto instance = dynamic_cast<Instance*>(object);
+        if (instance == nullptr)
+            continue;
+        auto mesh = dynamic_cast<const Mesh*>(instance->getGeometry());
+        if (mesh == nullptr || mesh->getLODCount() == 1)
+            continue;
+
+        // Distance to the nearest point of the bounding sphere, and the largest scale of the
+        // instance, which bounds how much an object-space error grows in world space
+        AABB box = instance->getAABB();
+        Vector3f center = (box.getMin() + box.getMax()) / 2;
+        float radius = (box.getMax() - box.getMin()).length() / 2;
+        float distance = std::max(1e-4f, (center - perspective->getCenter()).length() - radius);
+        Matrix4f m = instance->getMatrix();
+        float scale = 0;
+        for (int i = 0; i < 3; i++) {
+            scale = std::max(scale, Vector3f(m(0, i), m(1, i), m(2, i)).length());
+        }
+        float allowed = lod_threshold * perspective->getPixelSize(distance) / std::max(scale, 1e-8f);
+
+        int level = 0;
+        while (level + 1 < mesh->getLODCount() && mesh->getLODError(level + 1) <= allowed)
+            level++;
+        if (level == 0) {
+            instance->clearLOD();
+            continue;
+        }
+
+        // Fade in a level over the first half of its allowed range, so the error stays within the threshold
+        float error = mesh->getLODError(level);
+        float blend = error > 0 ? std::min(1.0f, (allowed - error) / (0.5f * error)) : 1.0f;
+        instance->setLOD(mesh->getLOD(level - 1), mesh->getLOD(level), blend);
+    }
+}
+
+int Scene::updateScene() {
+    selectLODs();
+    if (accelerator == nullptr) {
+        printf("Scene has not been built.\n");
+        exit(0);
+    }
+
+    auto dynamicBVH = dynamic_cast<DynamicBVH*>(accelerator);
+    if (dynamicBVH != nullptr) {
+        dynamicBVH->updateAll();
+        return 0;
+    }
+
+    // A lazy hierarchy is cheap to discard, since it is only built where rays go.
+    // Grids, kd-trees and the compressed and flat BVHs cannot be refitted in place.
+    auto bvh = dynamic_cast<BVHNode*>(accelerator);
+    if (bvh == nullptr) {
+        rebuild();
+        return 0;
+    }
+
+    bvh->refit();
+    return bvh->rebuildDegraded(rebuild_threshold);
 }